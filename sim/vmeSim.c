@@ -0,0 +1,1473 @@
+/*************************************************************************
+ *
+ *  vmeSim.c - Simulated VME backend for the UITF Mott readout lists
+ *
+ *    Link-time stand-in for the parts of libjvme, libti, libfadc and
+ *    libhd used by uitf_list.c and uitf_config.c.  Configuration calls
+ *    are accepted and remembered.  Block data is generated in the
+ *    JLab module data formats (not bit-exact) and served at the
+ *    configured trigger rate.  Every register access and DMA transfer
+ *    spins for the time the bus model charges for it, so wall clock
+ *    measurements of rocTrigger() follow the model.
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "jvme.h"
+#include "tiLib.h"
+#include "fadcLib.h"
+#include "hdLib.h"
+#include "vmeSim.h"
+
+#define SIM_MAX_SLOT      22
+#define SIM_MANUAL_DEPTH  4096
+#define SIM_MAX_BLOCK     (1024*64)	/* words, scratch for one generated block */
+
+#define SIM_TI_A32        0x0a000000
+#define SIM_NO_ARRIVAL    0xffffffffffffffffULL
+
+/* JLab module data format word types */
+#define SIM_TYPE(x)       ((1u << 31) | ((x) << 27))
+#define SIM_BLOCK_HEADER  SIM_TYPE(0)
+#define SIM_BLOCK_TRAILER SIM_TYPE(1)
+#define SIM_EVENT_HEADER  SIM_TYPE(2)
+#define SIM_TRIGGER_TIME  SIM_TYPE(3)
+#define SIM_WINDOW_RAW    SIM_TYPE(4)
+#define SIM_PULSE_INTEG   SIM_TYPE(7)
+#define SIM_HD_DECODER    SIM_TYPE(8)
+#define SIM_FILLER        SIM_TYPE(15)
+
+typedef struct
+{
+  uint64_t nread;		/* blocks read (or flushed) from this module */
+  uint32_t blocklevel;
+  uint32_t a32;
+  uint32_t enabled;
+} simModule_t;
+
+typedef struct
+{
+  simModule_t m;
+  int32_t  mode;
+  uint32_t ptw, nsb, nsa, np;
+  int32_t  blockError;
+  uint16_t dac[16];
+  uint16_t threshold[16];
+} simFadc_t;
+
+static vmeSimParams_t simParams;
+static vmeSimStats_t  simStats;
+static pthread_mutex_t simMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t simStartNs = 0;
+static uint64_t simManualArrival[SIM_MANUAL_DEPTH];
+static uint64_t simNmanual = 0;
+static uint32_t simXfer = VMESIM_2ESST267;
+static uint32_t simRand = 1;
+static uint32_t simIntCount = 0;
+static uint32_t simLastDmaBytes = 0;
+static uint32_t simHelicity = 0, simPatternPhase = 0;
+
+static simModule_t simTI = { 0, 1, SIM_TI_A32, 1 };
+static simModule_t simHD = { 0, 1, 0x09800000, 0 };
+static uint32_t    simHDslot = 21;
+static simFadc_t   simFA[SIM_MAX_SLOT];
+
+static uint32_t simScratch[SIM_MAX_BLOCK];
+
+/* Globals the readout lists reference from fadcLib */
+int nfadc = 0;
+u_long fadcA32Base = 0x08800000;
+uint32_t fadcAddrList[FA_MAX_BOARDS];
+
+/*************************************************************************
+ *  Timing model
+ */
+
+static uint64_t
+simNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+simSpin(uint64_t ns)
+{
+  uint64_t end = simNow() + ns;
+  while(simNow() < end)
+    ;
+}
+
+static void
+simCharge(int32_t stage, uint64_t ns, uint64_t nwords)
+{
+  pthread_mutex_lock(&simMutex);
+  simStats.ncalls[stage]++;
+  simStats.nwords[stage] += nwords;
+  simStats.ns[stage] += ns;
+  pthread_mutex_unlock(&simMutex);
+
+  simSpin(ns);
+}
+
+static uint64_t
+simDmaNs(uint32_t nbytes)
+{
+  uint32_t bw = simParams.bw_mbps[simXfer];
+  if(bw == 0)
+    bw = 1;
+
+  /* MB/s == bytes/us */
+  return simParams.dma_setup_ns + ((uint64_t)nbytes * 1000ULL) / bw;
+}
+
+/* Later descriptors of a linked list DMA don't pay the setup again */
+static uint64_t
+simDmaChainedNs(uint32_t nbytes)
+{
+  return simDmaNs(nbytes) - simParams.dma_setup_ns;
+}
+
+static uint32_t
+simRandom()
+{
+  simRand = simRand * 1103515245u + 12345u;
+  return (simRand >> 16) & 0x7fff;
+}
+
+/* Time that block iblock (0 = first) is complete at the TI */
+static uint64_t
+simArrival(uint64_t iblock)
+{
+  uint64_t arrival = SIM_NO_ARRIVAL;
+
+  pthread_mutex_lock(&simMutex);
+  if(simParams.trigger_rate > 0)
+    {
+      double dt = (double)(iblock + 1) * simTI.blocklevel / simParams.trigger_rate;
+      arrival = simStartNs + (uint64_t)(dt * 1e9);
+    }
+  else if(iblock < simNmanual)
+    arrival = simManualArrival[iblock % SIM_MANUAL_DEPTH];
+  pthread_mutex_unlock(&simMutex);
+
+  return arrival;
+}
+
+static int32_t
+simReady(simModule_t *m, uint32_t latency_ns)
+{
+  uint64_t arrival = simArrival(m->nread);
+
+  if(arrival == SIM_NO_ARRIVAL)
+    return 0;
+
+  return ((arrival + latency_ns) <= simNow());
+}
+
+/*************************************************************************
+ *  Block generators
+ */
+
+static uint32_t
+simTiBlock(volatile uint32_t *data)
+{
+  uint32_t iw = 0, iev, nev = simTI.blocklevel;
+  uint64_t evnum = simTI.nread * nev;
+
+  data[iw++] = 0;		/* bank length, filled below */
+  data[iw++] = (0xFF10 << 16) | (0x20 << 8) | (nev & 0xff);
+  for(iev = 0; iev < nev; iev++)
+    {
+      evnum++;
+      data[iw++] = (1 << 24) | (0x01 << 16) | 2;
+      data[iw++] = (uint32_t)evnum;
+      data[iw++] = (uint32_t)(evnum * 250);
+    }
+  data[0] = iw - 1;
+
+  return iw;
+}
+
+static uint32_t
+simHdBlock(volatile uint32_t *data)
+{
+  /* Octet: + - - + - + + - */
+  static const uint32_t octet = 0x96;
+  uint32_t iw = 0, iev, iword, nev = simHD.blocklevel;
+  uint64_t evnum = simHD.nread * nev;
+
+  data[iw++] = SIM_BLOCK_HEADER | (simHDslot << 22) |
+    ((simHD.nread & 0x3ff) << 8) | (nev & 0xff);
+  for(iev = 0; iev < nev; iev++)
+    {
+      uint32_t hel, tstamp;
+
+      evnum++;
+      tstamp = (uint32_t)(evnum * 250);
+      if(simPatternPhase == 0)
+	simHelicity = simRandom() & 0x1;
+      hel = ((octet >> simPatternPhase) & 0x1) ^ simHelicity;
+
+      data[iw++] = SIM_EVENT_HEADER | (simHDslot << 22) | (evnum & 0x3fffff);
+      data[iw++] = SIM_TRIGGER_TIME | (tstamp & 0xffffff);
+      data[iw++] = (tstamp >> 24) & 0xff;
+
+      /* helicity, pattern sync, pair sync, tsettle, pattern phase */
+      data[iw++] = SIM_HD_DECODER | (simPatternPhase << 8) |
+	((simPatternPhase & 0x1) ? 0 : (1 << 2)) |
+	((simPatternPhase == 0) << 1) | hel;
+      for(iword = 1; iword < simParams.hd_words; iword++)
+	data[iw++] = (uint32_t)evnum;
+
+      simPatternPhase = (simPatternPhase + 1) & 0x7;
+    }
+  data[iw] = SIM_BLOCK_TRAILER | (simHDslot << 22) | ((iw + 1) & 0x3fffff);
+  iw++;
+  if(iw & 0x1)
+    data[iw++] = SIM_FILLER | (simHDslot << 22);
+
+  return iw;
+}
+
+static uint32_t
+simSample(uint32_t isample, int32_t pulse_at, uint32_t amp)
+{
+  uint32_t s = 100 + (simRandom() % 7) - 3;
+  int32_t d = (int32_t)isample - pulse_at;
+
+  if(pulse_at >= 0)
+    {
+      if(d >= -2 && d < 0)
+	s += amp * (3 + d) / 3;
+      else if(d >= 0 && d < 8)
+	s += amp * (8 - d) / 8;
+    }
+
+  return s & 0xfff;
+}
+
+static uint32_t
+simFadcBlock(int32_t slot, volatile uint32_t *data)
+{
+  simFadc_t *fa = &simFA[slot];
+  uint32_t iw = 0, iev, ich, is, nev = fa->m.blocklevel;
+  uint64_t evnum = fa->m.nread * nev;
+  int32_t raw = (fa->mode == 1) || (fa->mode == 10);
+  int32_t integ = !raw || (fa->mode == 10);
+
+  data[iw++] = SIM_BLOCK_HEADER | (slot << 22) |
+    ((fa->m.nread & 0x3ff) << 8) | (nev & 0xff);
+  for(iev = 0; iev < nev; iev++)
+    {
+      uint32_t tstamp;
+
+      evnum++;
+      tstamp = (uint32_t)(evnum * 250);
+      data[iw++] = SIM_EVENT_HEADER | (slot << 22) | (evnum & 0x3fffff);
+      data[iw++] = SIM_TRIGGER_TIME | (tstamp & 0xffffff);
+      data[iw++] = (tstamp >> 24) & 0xff;
+
+      for(ich = 0; ich < simParams.fa_nchan; ich++)
+	{
+	  int32_t pulse_at = -1;
+	  uint32_t amp = 0;
+
+	  if((simRandom() % 100) < simParams.pulse_prob && fa->ptw > 16)
+	    {
+	      pulse_at = 4 + simRandom() % (fa->ptw - 16);
+	      amp = 200 + simRandom() % 1500;
+	    }
+
+	  if(raw)
+	    {
+	      data[iw++] = SIM_WINDOW_RAW | (ich << 23) | (fa->ptw & 0xfff);
+	      for(is = 0; is < fa->ptw; is += 2)
+		{
+		  uint32_t s1 = simSample(is, pulse_at, amp);
+		  uint32_t s2 = (is + 1 < fa->ptw) ?
+		    simSample(is + 1, pulse_at, amp) : 0x2000;
+		  data[iw++] = (s1 << 16) | s2;
+		}
+	    }
+
+	  if(integ)
+	    data[iw++] = SIM_PULSE_INTEG | (ich << 23) |
+	      ((100 * (fa->nsa + fa->nsb) + 10 * amp) & 0x7ffff);
+
+	  if(iw > (SIM_MAX_BLOCK - 0x1000))
+	    break;
+	}
+    }
+  data[iw] = SIM_BLOCK_TRAILER | (slot << 22) | ((iw + 1) & 0x3fffff);
+  iw++;
+  if(iw & 0x1)
+    data[iw++] = SIM_FILLER | (slot << 22);
+
+  return iw;
+}
+
+/* Copy out up to nwrds (0 = no limit) of the next block of a module */
+static int32_t
+simServe(simModule_t *m, uint32_t *block, uint32_t nblock,
+	 volatile uint32_t *data, int32_t nwrds, int32_t stage)
+{
+  uint32_t ncopy = nblock;
+
+  if((nwrds > 0) && (ncopy > (uint32_t)nwrds))
+    ncopy = nwrds;
+
+  memcpy((void *)data, block, ncopy << 2);
+  m->nread++;
+
+  simCharge(stage, simDmaNs(ncopy << 2), ncopy);
+
+  return ncopy;
+}
+
+/* Drop the blocks a module has ready, as a reset would */
+static void
+simClear(simModule_t *m, uint32_t latency_ns)
+{
+  while(simReady(m, latency_ns))
+    {
+      m->nread++;
+      simStats.blocks_dropped++;
+    }
+}
+
+static int32_t
+simStageOf(simModule_t *m)
+{
+  if(m == &simTI)
+    return VMESIM_TI_READ;
+  if(m == &simHD)
+    return VMESIM_HD_READ;
+  return VMESIM_FA_READ;
+}
+
+/*************************************************************************
+ *  Control interface
+ */
+
+void
+vmeSimDefaultParams(vmeSimParams_t *p)
+{
+  memset(p, 0, sizeof(*p));
+
+  p->trigger_rate    = 0;
+  p->sync_interval   = 0;
+  p->ti_latency_ns   = 2000;
+  p->hd_latency_ns   = 3000;
+  p->fa_latency_ns   = 4000;
+  p->single_cycle_ns = 800;
+  p->dma_setup_ns    = 8000;
+  p->dma_config_ns   = 2000;
+
+  p->bw_mbps[VMESIM_D16]      = 2;
+  p->bw_mbps[VMESIM_D32]      = 5;
+  p->bw_mbps[VMESIM_BLK32]    = 25;
+  p->bw_mbps[VMESIM_MBLK]     = 50;
+  p->bw_mbps[VMESIM_2EVME]    = 80;
+  p->bw_mbps[VMESIM_2ESST160] = 120;
+  p->bw_mbps[VMESIM_2ESST267] = 170;
+  p->bw_mbps[VMESIM_2ESST320] = 200;
+
+  p->fa_nchan   = 16;
+  p->hd_words   = 4;
+  p->pulse_prob = 20;
+  p->seed       = 1;
+}
+
+int32_t
+vmeSimSetParams(const vmeSimParams_t *p)
+{
+  if(p == NULL)
+    {
+      printf("%s: ERROR: NULL params\n", __func__);
+      return -1;
+    }
+
+  pthread_mutex_lock(&simMutex);
+  simParams = *p;
+  simRand = simParams.seed ? simParams.seed : 1;
+  pthread_mutex_unlock(&simMutex);
+
+  return 0;
+}
+
+void
+vmeSimGetParams(vmeSimParams_t *p)
+{
+  pthread_mutex_lock(&simMutex);
+  *p = simParams;
+  pthread_mutex_unlock(&simMutex);
+}
+
+#define SIM_ENV(x_name, x_field) {					\
+    const char *v = getenv("VMESIM_" x_name);				\
+    if(v) p.x_field = strtoul(v, NULL, 0);}
+
+int32_t
+vmeSimLoadEnv()
+{
+  static const char *bwnames[VMESIM_NXFER] =
+    { "D16", "D32", "BLK32", "MBLK", "2EVME",
+      "2ESST160", "2ESST267", "2ESST320" };
+  vmeSimParams_t p;
+  const char *v;
+  int32_t ix;
+
+  vmeSimGetParams(&p);
+
+  v = getenv("VMESIM_RATE");
+  if(v)
+    p.trigger_rate = strtod(v, NULL);
+
+  SIM_ENV("SYNC_INTERVAL", sync_interval);
+  SIM_ENV("TI_LATENCY_NS", ti_latency_ns);
+  SIM_ENV("HD_LATENCY_NS", hd_latency_ns);
+  SIM_ENV("FA_LATENCY_NS", fa_latency_ns);
+  SIM_ENV("SINGLE_CYCLE_NS", single_cycle_ns);
+  SIM_ENV("DMA_SETUP_NS", dma_setup_ns);
+  SIM_ENV("DMA_CONFIG_NS", dma_config_ns);
+  SIM_ENV("FA_NCHAN", fa_nchan);
+  SIM_ENV("HD_WORDS", hd_words);
+  SIM_ENV("PULSE_PROB", pulse_prob);
+  SIM_ENV("SEED", seed);
+
+  for(ix = 0; ix < VMESIM_NXFER; ix++)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "VMESIM_BW_%s", bwnames[ix]);
+      v = getenv(name);
+      if(v)
+	p.bw_mbps[ix] = strtoul(v, NULL, 0);
+    }
+
+  return vmeSimSetParams(&p);
+}
+
+__attribute__((constructor)) static void
+vmeSimLoad()
+{
+  vmeSimParams_t p;
+
+  vmeSimDefaultParams(&p);
+  vmeSimSetParams(&p);
+  vmeSimLoadEnv();
+}
+
+/* Restart the trigger clock and the module read pointers */
+int32_t
+vmeSimStart()
+{
+  int32_t islot;
+
+  pthread_mutex_lock(&simMutex);
+  simStartNs = simNow();
+  simNmanual = 0;
+  simIntCount = 0;
+  pthread_mutex_unlock(&simMutex);
+
+  simTI.nread = 0;
+  simHD.nread = 0;
+  for(islot = 0; islot < SIM_MAX_SLOT; islot++)
+    {
+      simFA[islot].m.nread = 0;
+      simFA[islot].blockError = 0;
+    }
+  simPatternPhase = 0;
+
+  return 0;
+}
+
+/* Complete nblocks blocks now (for trigger_rate == 0) */
+int32_t
+vmeSimTrigger(uint32_t nblocks)
+{
+  uint32_t ib;
+  uint64_t now = simNow();
+
+  pthread_mutex_lock(&simMutex);
+  for(ib = 0; ib < nblocks; ib++)
+    {
+      simManualArrival[simNmanual % SIM_MANUAL_DEPTH] = now;
+      simNmanual++;
+    }
+  pthread_mutex_unlock(&simMutex);
+
+  return nblocks;
+}
+
+/* What the TI polling thread does: wait for the next block, count it */
+int32_t
+vmeSimWaitTrigger(uint32_t timeout_ms)
+{
+  uint64_t arrival, deadline = simNow() + (uint64_t)timeout_ms * 1000000ULL;
+
+  arrival = simArrival(simIntCount);
+  while(arrival == SIM_NO_ARRIVAL ||
+	(arrival + simParams.ti_latency_ns) > simNow())
+    {
+      if(simNow() > deadline)
+	return 0;
+      if(arrival == SIM_NO_ARRIVAL)
+	arrival = simArrival(simIntCount);
+    }
+
+  simIntCount++;
+  return 1;
+}
+
+void
+vmeSimGetStats(vmeSimStats_t *s)
+{
+  pthread_mutex_lock(&simMutex);
+  *s = simStats;
+  s->blocks_generated = simTI.nread;
+  pthread_mutex_unlock(&simMutex);
+}
+
+void
+vmeSimResetStats()
+{
+  pthread_mutex_lock(&simMutex);
+  memset(&simStats, 0, sizeof(simStats));
+  pthread_mutex_unlock(&simMutex);
+}
+
+const char *
+vmeSimStageName(int32_t stage)
+{
+  static const char *names[VMESIM_NSTAGE] =
+    { "tiBReady", "tiReadTriggerBlock", "hdBReady", "hdReadBlock",
+      "faBready", "faReadBlock", "vmeDmaConfig", "vmeDmaFlush" };
+
+  if((stage < 0) || (stage >= VMESIM_NSTAGE))
+    return "unknown";
+
+  return names[stage];
+}
+
+/*************************************************************************
+ *  jvme
+ */
+
+int
+vmeOpenDefaultWindows()
+{
+  return OK;
+}
+
+int
+vmeCloseDefaultWindows()
+{
+  return OK;
+}
+
+void
+vmeSetQuietFlag(unsigned int pflag)
+{
+}
+
+int
+vmeBusLock()
+{
+  return OK;
+}
+
+int
+vmeBusUnlock()
+{
+  return OK;
+}
+
+int
+vmeDmaConfig(unsigned int addrType, unsigned int dataType, unsigned int sstMode)
+{
+  if(dataType < 5)
+    simXfer = dataType;
+  else
+    simXfer = VMESIM_2ESST160 + ((sstMode > 2) ? 2 : sstMode);
+
+  simCharge(VMESIM_DMA_CONFIG, simParams.dma_config_ns, 0);
+
+  return OK;
+}
+
+/* Find the simulated module behind an A32 address */
+static simModule_t *
+simModuleAt(unsigned int addr, int32_t *slot)
+{
+  int32_t islot;
+
+  *slot = -1;
+  if(addr == simTI.a32)
+    return &simTI;
+  if(addr == simHD.a32)
+    return &simHD;
+
+  for(islot = 0; islot < SIM_MAX_SLOT; islot++)
+    if(simFA[islot].m.a32 && (addr == simFA[islot].m.a32))
+      {
+	*slot = islot;
+	return &simFA[islot].m;
+      }
+
+  return NULL;
+}
+
+static uint32_t
+simLatency(simModule_t *m)
+{
+  if(m == &simTI)
+    return simParams.ti_latency_ns;
+  if(m == &simHD)
+    return simParams.hd_latency_ns;
+  return simParams.fa_latency_ns;
+}
+
+static uint32_t
+simGenerate(simModule_t *m, int32_t slot, volatile uint32_t *data)
+{
+  if(m == &simTI)
+    return simTiBlock(data);
+  if(m == &simHD)
+    return simHdBlock(data);
+  return simFadcBlock(slot, data);
+}
+
+int
+vmeDmaFlush(unsigned int addr)
+{
+  simModule_t *m;
+  int32_t slot, nbytes = 0;
+
+  m = simModuleAt(addr, &slot);
+  if(m == NULL)
+    return ERROR;
+
+  while(simReady(m, simLatency(m)))
+    {
+      uint32_t nw = simGenerate(m, slot, simScratch);
+      nbytes += nw << 2;
+      m->nread++;
+      simStats.blocks_dropped++;
+    }
+  simCharge(VMESIM_DMA_FLUSH, simDmaNs(nbytes), nbytes >> 2);
+
+  return nbytes;
+}
+
+int
+vmeDmaSend(unsigned long locAdrs, unsigned int vmeAdrs, int size)
+{
+  simModule_t *m;
+  int32_t slot, stage;
+  uint32_t nw;
+
+  simLastDmaBytes = 0;
+  m = simModuleAt(vmeAdrs, &slot);
+  if(m == NULL)
+    return ERROR;
+
+  if(!simReady(m, simLatency(m)))
+    return OK;
+
+  stage = simStageOf(m);
+
+  nw = simGenerate(m, slot, simScratch);
+  simLastDmaBytes = simServe(m, simScratch, nw,
+			     (volatile uint32_t *)locAdrs, size >> 2, stage) << 2;
+
+  return OK;
+}
+
+#define SIM_MAX_LL 32
+static uint32_t simLLnt = 0;
+static unsigned long simLLlocal;
+static uint32_t simLLvme[SIM_MAX_LL], simLLsize[SIM_MAX_LL];
+
+int
+vmeDmaSetupLL(unsigned long locAdrs, unsigned int *vmeAdrs,
+	      unsigned int *dmaSize, unsigned int numt)
+{
+  if(numt > SIM_MAX_LL)
+    return ERROR;
+
+  simLLlocal = locAdrs;
+  simLLnt = numt;
+  memcpy(simLLvme, vmeAdrs, numt * sizeof(uint32_t));
+  memcpy(simLLsize, dmaSize, numt * sizeof(uint32_t));
+
+  return OK;
+}
+
+/* Descriptors run back to back into one local buffer.  A module with
+   less data than its descriptor asks for ends the chain (bus error). */
+int
+vmeDmaSendLL()
+{
+  volatile uint32_t *data = (volatile uint32_t *)simLLlocal;
+  uint32_t it, nw, nwant;
+  int32_t slot;
+
+  simLastDmaBytes = 0;
+  for(it = 0; it < simLLnt; it++)
+    {
+      simModule_t *m = simModuleAt(simLLvme[it], &slot);
+      if((m == NULL) || !simReady(m, simLatency(m)))
+	break;
+
+      nw = simGenerate(m, slot, simScratch);
+      nwant = simLLsize[it] >> 2;
+      if(nw > nwant)
+	nw = nwant;
+
+      memcpy((void *)data, simScratch, nw << 2);
+      m->nread++;
+      data += nw;
+      simLastDmaBytes += nw << 2;
+
+      simCharge(simStageOf(m),
+		(it == 0) ? simDmaNs(nw << 2) : simDmaChainedNs(nw << 2), nw);
+
+      if(nw < nwant)
+	break;
+    }
+
+  return OK;
+}
+
+int
+vmeDmaDone()
+{
+  return simLastDmaBytes;
+}
+
+/* Event buffer pools.  Plain heap memory: the simulated DMA copies into
+   any local address */
+#define SIM_MAX_POOL 8
+
+typedef struct
+{
+  DMA_MEM_ID id;
+  int32_t    nitem;
+  int32_t    nfree;
+  DMANODE  **item;
+  DMANODE  **freelist;
+} simPool_t;
+
+static simPool_t simPool[SIM_MAX_POOL];
+
+static simPool_t *
+simPoolOf(DMA_MEM_ID id)
+{
+  int32_t ipool;
+
+  for(ipool = 0; ipool < SIM_MAX_POOL; ipool++)
+    if((id != NULL) && (simPool[ipool].id == id))
+      return &simPool[ipool];
+
+  return NULL;
+}
+
+DMA_MEM_ID
+dmaPCreate(char *name, int size, int c, int incr)
+{
+  simPool_t *pool = NULL;
+  int32_t ipool, iitem;
+
+  for(ipool = 0; ipool < SIM_MAX_POOL; ipool++)
+    if(simPool[ipool].id == NULL)
+      {
+	pool = &simPool[ipool];
+	break;
+      }
+
+  if(pool == NULL)
+    return NULL;
+
+  pool->id = (DMA_MEM_ID)calloc(1, sizeof(*(DMA_MEM_ID)0));
+  pool->nitem = c;
+  pool->item = (DMANODE **)calloc(c, sizeof(DMANODE *));
+  pool->freelist = (DMANODE **)calloc(c, sizeof(DMANODE *));
+  for(iitem = 0; iitem < c; iitem++)
+    pool->item[iitem] = (DMANODE *)calloc(1, sizeof(DMANODE) + size);
+
+  dmaPReInit(pool->id);
+
+  return pool->id;
+}
+
+void
+dmaPFree(DMA_MEM_ID pPart)
+{
+  simPool_t *pool = simPoolOf(pPart);
+  int32_t iitem;
+
+  if(pool == NULL)
+    return;
+
+  for(iitem = 0; iitem < pool->nitem; iitem++)
+    free(pool->item[iitem]);
+  free(pool->item);
+  free(pool->freelist);
+  free((void *)pool->id);
+  memset(pool, 0, sizeof(*pool));
+}
+
+int
+dmaPReInit(DMA_MEM_ID pPart)
+{
+  simPool_t *pool = simPoolOf(pPart);
+
+  if(pool == NULL)
+    return ERROR;
+
+  memcpy(pool->freelist, pool->item, pool->nitem * sizeof(DMANODE *));
+  pool->nfree = pool->nitem;
+
+  return OK;
+}
+
+int
+dmaPReInitAll()
+{
+  int32_t ipool;
+
+  for(ipool = 0; ipool < SIM_MAX_POOL; ipool++)
+    if(simPool[ipool].id != NULL)
+      dmaPReInit(simPool[ipool].id);
+
+  return OK;
+}
+
+DMANODE *
+dmaPGetItem(DMA_MEM_ID pPart)
+{
+  simPool_t *pool = simPoolOf(pPart);
+
+  if((pool == NULL) || (pool->nfree == 0))
+    return NULL;
+
+  return pool->freelist[--pool->nfree];
+}
+
+void
+dmaPFreeItem(DMANODE *pItem)
+{
+  int32_t ipool, iitem;
+
+  for(ipool = 0; ipool < SIM_MAX_POOL; ipool++)
+    for(iitem = 0; iitem < simPool[ipool].nitem; iitem++)
+      if(simPool[ipool].item[iitem] == pItem)
+	{
+	  simPool[ipool].freelist[simPool[ipool].nfree++] = pItem;
+	  return;
+	}
+}
+
+#ifndef taskDelay
+int
+taskDelay(int ticks)
+{
+  struct timespec ts = { 0, ticks * 16666667L };
+  nanosleep(&ts, NULL);
+  return OK;
+}
+#endif
+
+/*************************************************************************
+ *  tiLib
+ */
+
+int
+tiInit(unsigned int tAddr, unsigned int mode, int iFlag)
+{
+  if(!(iFlag & TI_INIT_NO_INIT))
+    simTI.nread = 0;
+  return OK;
+}
+
+int
+tiStatus(int pflag)
+{
+  printf("vmeSim: TI  blocklevel %d  blocks read %llu  triggers %u\n",
+	 simTI.blocklevel, (unsigned long long)simTI.nread, simIntCount);
+  return OK;
+}
+
+int
+tiBReady()
+{
+  int32_t nready = 0;
+  uint64_t now, save = simTI.nread;
+
+  now = simNow();
+  while(nready < 0xff)
+    {
+      uint64_t arrival = simArrival(simTI.nread + nready);
+      if((arrival == SIM_NO_ARRIVAL) ||
+	 ((arrival + simParams.ti_latency_ns) > now))
+	break;
+      nready++;
+    }
+  simTI.nread = save;
+
+  simCharge(VMESIM_TI_BREADY, simParams.single_cycle_ns, 0);
+
+  return nready;
+}
+
+int
+tiReadTriggerBlock(volatile unsigned int *data)
+{
+  uint32_t nw;
+
+  if(!simReady(&simTI, simParams.ti_latency_ns))
+    return ERROR;
+
+  nw = simTiBlock(simScratch);
+  return simServe(&simTI, simScratch, nw, data, 0, VMESIM_TI_READ);
+}
+
+int
+tiResetBlockReadout()
+{
+  simClear(&simTI, simParams.ti_latency_ns);
+  return OK;
+}
+
+unsigned int
+tiGetAdr32()
+{
+  return simTI.a32;
+}
+
+int
+tiGetSyncEventFlag()
+{
+  if(simParams.sync_interval == 0 || simTI.nread == 0)
+    return 0;
+
+  return ((simTI.nread % simParams.sync_interval) == 0);
+}
+
+unsigned int
+tiGetIntCount()
+{
+  return simIntCount;
+}
+
+int
+tiIntEnable(int iflag)
+{
+  return OK;
+}
+
+int
+tiIntDisable()
+{
+  return OK;
+}
+
+int
+tiSetBlockLevel(int blockLevel)
+{
+  simTI.blocklevel = blockLevel ? blockLevel : 1;
+  return OK;
+}
+
+int
+tiSetBlockBufferLevel(unsigned int level)
+{
+  return OK;
+}
+
+int
+tiSetTriggerHoldoff(int rule, unsigned int value, int timestep)
+{
+  return OK;
+}
+
+int
+tiLoadTriggerTable(int mode)
+{
+  return OK;
+}
+
+int
+tiSetPromptTriggerWidth(int width)
+{
+  return OK;
+}
+
+int
+tiEnableTSInput(unsigned int inpMask)
+{
+  return OK;
+}
+
+int
+tiSetTriggerSource(int trig)
+{
+  return OK;
+}
+
+int
+tiResetSlaveConfig()
+{
+  return OK;
+}
+
+/* Triggers come from the rate model, and are not gated */
+int
+tiDisableTriggerSource(int fflag)
+{
+  return OK;
+}
+
+int
+tiEnableTriggerSource()
+{
+  return OK;
+}
+
+/*************************************************************************
+ *  fadcLib
+ */
+
+int
+faInit(UINT32 addr, UINT32 addr_inc, int nadc, int iFlag)
+{
+  nfadc = nadc;
+  return OK;
+}
+
+void
+faDisableMultiBlock()
+{
+}
+
+int
+faSDC_Init_Integrating(int addr)
+{
+  return OK;
+}
+
+int
+faSDC_Sync()
+{
+  return OK;
+}
+
+int
+faSDC_Sync_Integrating()
+{
+  return OK;
+}
+
+void
+faSDC_Status(int sflag)
+{
+}
+
+void
+faSDC_Status_Integrating(int sflag)
+{
+}
+
+void
+faGStatus(int sflag)
+{
+  int32_t islot;
+
+  for(islot = 0; islot < SIM_MAX_SLOT; islot++)
+    if(simFA[islot].m.a32)
+      printf("vmeSim: FADC slot %2d  mode %d  ptw %d  blocks read %llu\n",
+	     islot, simFA[islot].mode, simFA[islot].ptw,
+	     (unsigned long long)simFA[islot].m.nread);
+}
+
+/* Boards come into existence when first configured by slot */
+static simFadc_t *
+simFadc(int id)
+{
+  if((id < 0) || (id >= SIM_MAX_SLOT))
+    return NULL;
+
+  if(simFA[id].m.a32 == 0)
+    {
+      simFA[id].m.a32 = fadcA32Base + (id << 19);
+      simFA[id].m.blocklevel = 1;
+      simFA[id].mode = 1;
+    }
+
+  return &simFA[id];
+}
+
+int
+faSetClockSource(int id, int clkSrc)
+{
+  simFadc(id);
+  return OK;
+}
+
+void
+faSoftReset(int id, int cflag)
+{
+  simFadc(id);
+}
+
+void
+faResetTriggerCount(int id)
+{
+}
+
+void
+faEnableBusError(int id)
+{
+}
+
+void
+faEnableTriggerOut(int id, int output)
+{
+}
+
+int
+faSetBlockLevel(int id, int level)
+{
+  simFadc_t *fa = simFadc(id);
+
+  if(fa == NULL)
+    return ERROR;
+
+  fa->m.blocklevel = level ? level : 1;
+  return OK;
+}
+
+/* One read-modify-write per channel in the mask */
+int
+faSetDAC(int id, unsigned short dvalue, unsigned short chmask)
+{
+  simFadc_t *fa = simFadc(id);
+  int32_t ich;
+
+  if(fa == NULL)
+    return ERROR;
+
+  for(ich = 0; ich < 16; ich++)
+    if(chmask & (1 << ich))
+      {
+	fa->dac[ich] = dvalue;
+	simSpin(2 * simParams.single_cycle_ns);
+      }
+  return OK;
+}
+
+unsigned int
+faGetChannelDAC(int id, unsigned int chan)
+{
+  simFadc_t *fa = simFadc(id);
+
+  if((fa == NULL) || (chan >= 16))
+    return ERROR;
+
+  simSpin(simParams.single_cycle_ns);
+  return fa->dac[chan];
+}
+
+int
+faSetThreshold(int id, unsigned short tvalue, unsigned short chmask)
+{
+  simFadc_t *fa = simFadc(id);
+  int32_t ich;
+
+  if(fa == NULL)
+    return ERROR;
+
+  for(ich = 0; ich < 16; ich++)
+    if(chmask & (1 << ich))
+      {
+	fa->threshold[ich] = tvalue;
+	simSpin(2 * simParams.single_cycle_ns);
+      }
+  return OK;
+}
+
+int
+faGetChThreshold(int id, int ch)
+{
+  simFadc_t *fa = simFadc(id);
+
+  if((fa == NULL) || (ch < 0) || (ch >= 16))
+    return ERROR;
+
+  simSpin(simParams.single_cycle_ns);
+  return fa->threshold[ch];
+}
+
+int
+faSetProcMode(int id, int pmode, unsigned int PL, unsigned int PTW,
+	      unsigned int NSB, unsigned int NSA, unsigned int NP, int bank)
+{
+  simFadc_t *fa = simFadc(id);
+
+  if(fa == NULL)
+    return ERROR;
+
+  fa->mode = pmode;
+  fa->ptw = PTW;
+  fa->nsb = NSB;
+  fa->nsa = NSA;
+  fa->np = NP;
+
+  return OK;
+}
+
+int
+faSetMottDelay(int id, int chan, int delay)
+{
+  return OK;
+}
+
+int
+faSetHitbitsMode(int id, int enable)
+{
+  return OK;
+}
+
+int
+faBready(int id)
+{
+  simFadc_t *fa = simFadc(id);
+
+  simCharge(VMESIM_FA_BREADY, simParams.single_cycle_ns, 0);
+
+  if(fa == NULL)
+    return ERROR;
+
+  return simReady(&fa->m, simParams.fa_latency_ns);
+}
+
+unsigned int
+faGBready()
+{
+  uint32_t mask = 0;
+  int32_t islot;
+
+  simCharge(VMESIM_FA_BREADY, simParams.single_cycle_ns, 0);
+
+  for(islot = 0; islot < SIM_MAX_SLOT; islot++)
+    if(simFA[islot].m.a32 &&
+       simReady(&simFA[islot].m, simParams.fa_latency_ns))
+      mask |= (1 << islot);
+
+  return mask;
+}
+
+int
+faReadBlock(int id, volatile UINT32 *data, int nwrds, int rflag)
+{
+  simFadc_t *fa = simFadc(id);
+  uint32_t nw;
+  int32_t dCnt;
+
+  if(fa == NULL)
+    return ERROR;
+
+  if(!simReady(&fa->m, simParams.fa_latency_ns))
+    {
+      fa->blockError = 1;
+      return 0;
+    }
+
+  nw = simFadcBlock(id, simScratch);
+  dCnt = simServe(&fa->m, simScratch, nw, data, nwrds, VMESIM_FA_READ);
+  if((uint32_t)dCnt < nw)
+    fa->blockError = 1;
+
+  return dCnt;
+}
+
+int
+faGetBlockError(int pflag)
+{
+  int32_t islot, rval = 0;
+
+  for(islot = 0; islot < SIM_MAX_SLOT; islot++)
+    {
+      if(simFA[islot].blockError)
+	rval = 1;
+      if(pflag)
+	simFA[islot].blockError = 0;
+    }
+
+  return rval;
+}
+
+unsigned int
+faGetA32(int id)
+{
+  simFadc_t *fa = simFadc(id);
+
+  return fa ? fa->m.a32 : 0;
+}
+
+void
+faEnableSyncSrc(int id)
+{
+}
+
+void
+faEnable(int id, int eSync, int eTrig)
+{
+  simFadc_t *fa = simFadc(id);
+
+  if(fa)
+    fa->m.enabled = 1;
+}
+
+void
+faGDisable(int eFlag)
+{
+  int32_t islot;
+
+  for(islot = 0; islot < SIM_MAX_SLOT; islot++)
+    simFA[islot].m.enabled = 0;
+}
+
+void
+faGReset(int iFlag)
+{
+}
+
+void
+faClear(int id)
+{
+  simFadc_t *fa = simFadc(id);
+
+  if(fa)
+    simClear(&fa->m, simParams.fa_latency_ns);
+}
+
+/*************************************************************************
+ *  hdLib
+ */
+
+int
+hdInit(unsigned int vAddr, unsigned int source, unsigned int fiber, int iFlag)
+{
+  simHDslot = (vAddr >> 19) & 0x1f;
+  simHD.nread = 0;
+  return OK;
+}
+
+int
+hdSetA32(unsigned int a32base)
+{
+  simHD.a32 = a32base;
+  return OK;
+}
+
+unsigned int
+hdGetA32()
+{
+  return simHD.a32;
+}
+
+int
+hdStatus(int pflag)
+{
+  printf("vmeSim: HD  slot %d  blocks read %llu\n",
+	 simHDslot, (unsigned long long)simHD.nread);
+  return OK;
+}
+
+int
+hdBReady()
+{
+  simCharge(VMESIM_HD_BREADY, simParams.single_cycle_ns, 0);
+
+  return simReady(&simHD, simParams.hd_latency_ns);
+}
+
+int
+hdReadBlock(volatile unsigned int *data, int nwrds, int rflag)
+{
+  uint32_t nw;
+
+  if(!simReady(&simHD, simParams.hd_latency_ns))
+    return 0;
+
+  nw = simHdBlock(simScratch);
+  return simServe(&simHD, simScratch, nw, data, nwrds, VMESIM_HD_READ);
+}
+
+int
+hdSetProcDelay(unsigned short input_delay, unsigned short trigger_latency_delay)
+{
+  return OK;
+}
+
+int
+hdSetBlocklevel(int blklevel)
+{
+  simHD.blocklevel = blklevel ? blklevel : 1;
+  return OK;
+}
+
+int
+hdEnableDecoder()
+{
+  return OK;
+}
+
+int
+hdSetHelicitySource(int source, int scaler, int polarity)
+{
+  return OK;
+}
+
+int
+hdHelicityGeneratorConfig(int pattern, int windowDelay, int settleTime,
+			  int stableTime, unsigned int seed)
+{
+  return OK;
+}
+
+int
+hdEnableHelicityGenerator()
+{
+  return OK;
+}
+
+int
+hdEnable()
+{
+  simHD.enabled = 1;
+  return OK;
+}
+
+int
+hdDisable()
+{
+  simHD.enabled = 0;
+  return OK;
+}
+
+int
+hdReset(int type, int clearA32)
+{
+  simClear(&simHD, simParams.hd_latency_ns);
+  return OK;
+}
@@ -0,0 +1,86 @@
+#pragma once
+/*************************************************************************
+ *
+ *  vmeSim.h - Simulated VME backend for the UITF Mott readout lists
+ *
+ *    libvmesim.so stands in for libjvme, libti, libfadc and libhd at
+ *    link time.  Blocks are served from memory at a configurable
+ *    trigger rate with configurable module latencies and a VME
+ *    bus timing model (single cycle, BLT/MBLT/2eVME/2eSST).
+ *
+ *    Parameters are taken from the environment (VMESIM_*) when the
+ *    library is loaded, and may be changed with vmeSimSetParams().
+ *
+ */
+
+#include <stdint.h>
+
+/* Transfer modes, in the order of vmeDmaConfig(..., dataType, sstMode) */
+enum vmeSimXferMode
+  {
+    VMESIM_D16 = 0,
+    VMESIM_D32,
+    VMESIM_BLK32,
+    VMESIM_MBLK,
+    VMESIM_2EVME,
+    VMESIM_2ESST160,
+    VMESIM_2ESST267,
+    VMESIM_2ESST320,
+    VMESIM_NXFER
+  };
+
+typedef struct
+{
+  double   trigger_rate;          /* Hz. 0 = blocks only from vmeSimTrigger() */
+  uint32_t sync_interval;         /* Flag every Nth block as SYNC. 0 = never */
+
+  uint32_t ti_latency_ns;         /* Trigger to block ready, per module */
+  uint32_t hd_latency_ns;
+  uint32_t fa_latency_ns;
+
+  uint32_t single_cycle_ns;       /* One A24/A32 register access */
+  uint32_t dma_setup_ns;          /* Bridge setup + first word, per transfer */
+  uint32_t dma_config_ns;         /* Rewriting the bridge DMA registers */
+  uint32_t bw_mbps[VMESIM_NXFER]; /* Sustained bandwidth per transfer mode */
+
+  uint32_t fa_nchan;              /* Channels reported per FADC event */
+  uint32_t hd_words;              /* Decoder data words per HD event */
+  uint32_t pulse_prob;            /* Chance (percent) of a pulse in a window */
+  uint32_t seed;
+} vmeSimParams_t;
+
+/* Per-call accounting, indexed by the enum below */
+enum vmeSimStage
+  {
+    VMESIM_TI_BREADY = 0,
+    VMESIM_TI_READ,
+    VMESIM_HD_BREADY,
+    VMESIM_HD_READ,
+    VMESIM_FA_BREADY,
+    VMESIM_FA_READ,
+    VMESIM_DMA_CONFIG,
+    VMESIM_DMA_FLUSH,
+    VMESIM_NSTAGE
+  };
+
+typedef struct
+{
+  uint64_t ncalls[VMESIM_NSTAGE];
+  uint64_t nwords[VMESIM_NSTAGE];
+  uint64_t ns[VMESIM_NSTAGE];     /* Modelled bus time charged */
+  uint64_t blocks_generated;
+  uint64_t blocks_dropped;        /* Discarded by vmeDmaFlush or a module reset */
+} vmeSimStats_t;
+
+void    vmeSimDefaultParams(vmeSimParams_t *p);
+int32_t vmeSimSetParams(const vmeSimParams_t *p);
+void    vmeSimGetParams(vmeSimParams_t *p);
+int32_t vmeSimLoadEnv();
+
+int32_t vmeSimStart();
+int32_t vmeSimTrigger(uint32_t nblocks);
+int32_t vmeSimWaitTrigger(uint32_t timeout_ms);
+
+void    vmeSimGetStats(vmeSimStats_t *s);
+void    vmeSimResetStats();
+const char *vmeSimStageName(int32_t stage);
@@ -0,0 +1,304 @@
+/*************************************************************************
+ *
+ *  bench_readout.c - Per-block readout latency of the UITF readout list
+ *
+ *    Loads a readout list built against the simulated VME backend
+ *    (../uitf_list_sim.so, see ../sim) and drives it through
+ *    rocDownload, rocPrestart, rocGo, N x rocTrigger and rocEnd, for
+ *    counting and/or integrating run types.
+ *
+ *    Reports trigger-to-bank-close latency percentiles, words/s and
+ *    the modelled bus time of each readout stage.  Bus timing, trigger
+ *    rate and module latencies come from the VMESIM_* environment.
+ *
+ *    Usage:
+ *      bench_readout [-n ntrig] [-m counting|integrating|both]
+ *                    [-c configfile] [-l readout_list.so] [-r rate_hz]
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <dlfcn.h>
+#include <time.h>
+
+#include "rolInt.h"
+#include "vmeSim.h"
+
+#define BENCH_BUFFER_WORDS (1024*1024)
+
+typedef void (*rocfunc_t)();
+typedef void (*roctrig_t)(int);
+typedef void (*initfunc_t)(rolParam);
+
+static uint32_t userBuffer[BENCH_BUFFER_WORDS];
+static uint32_t dataBuffer[BENCH_BUFFER_WORDS];
+
+/* Normally provided by the ROC */
+void
+daLogMsg(char *severity, char *fmt, ...)
+{
+  va_list args;
+
+  printf("daLogMsg: %s: ", severity);
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+  printf("\n");
+}
+
+static uint64_t
+benchNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double
+percentile(uint64_t *sorted, uint32_t n, double p)
+{
+  uint32_t idx;
+
+  if(n == 0)
+    return 0;
+
+  idx = (uint32_t)(p * (n - 1) + 0.5);
+  return sorted[idx] / 1000.;
+}
+
+typedef struct
+{
+  void       *handle;
+  initfunc_t  init;
+  rocfunc_t   download, prestart, go, end;
+  roctrig_t   trigger;
+  volatile unsigned int **dabufp;
+} benchList_t;
+
+static int32_t
+benchLoad(const char *listname, benchList_t *list)
+{
+  char initname[256], *base, *copy;
+
+  list->handle = dlopen(listname, RTLD_NOW | RTLD_GLOBAL);
+  if(list->handle == NULL)
+    {
+      printf("%s: ERROR: %s\n", __func__, dlerror());
+      return -1;
+    }
+
+  /* INIT_NAME is <listname>__init, as set in the Makefile */
+  copy = strdup(listname);
+  base = basename(copy);
+  if(strstr(base, ".so"))
+    *strstr(base, ".so") = 0;
+  snprintf(initname, sizeof(initname), "%s__init", base);
+  free(copy);
+
+  list->init     = (initfunc_t)dlsym(list->handle, initname);
+  list->download = (rocfunc_t)dlsym(list->handle, "rocDownload");
+  list->prestart = (rocfunc_t)dlsym(list->handle, "rocPrestart");
+  list->go       = (rocfunc_t)dlsym(list->handle, "rocGo");
+  list->end      = (rocfunc_t)dlsym(list->handle, "rocEnd");
+  list->trigger  = (roctrig_t)dlsym(list->handle, "rocTrigger");
+  list->dabufp   = (volatile unsigned int **)dlsym(list->handle, "dma_dabufp");
+
+  if(!list->init || !list->download || !list->prestart || !list->go ||
+     !list->end || !list->trigger || !list->dabufp)
+    {
+      printf("%s: ERROR: %s is missing a readout list entry point (%s)\n",
+	     __func__, listname, initname);
+      return -1;
+    }
+
+  return 0;
+}
+
+static int32_t
+benchRun(benchList_t *list, rolParam rol, const char *runtype, uint32_t ntrig)
+{
+  uint64_t *latency, t0, t1, tstart, tstop, nwords = 0, sumlat = 0;
+  uint32_t itrig, nlat = 0, ntimeout = 0, stage;
+  vmeSimStats_t stats;
+  double elapsed, bus_ns = 0;
+
+  latency = calloc(ntrig, sizeof(uint64_t));
+  if(latency == NULL)
+    {
+      printf("%s: ERROR allocating latency array\n", __func__);
+      return -1;
+    }
+
+  rol->usrString = (char *)runtype;
+  rol->dabufp = (void *)userBuffer;
+
+  rol->daproc = DA_DOWNLOAD_PROC;
+  (*list->download)();
+  rol->daproc = DA_PRESTART_PROC;
+  (*list->prestart)();
+  rol->daproc = DA_GO_PROC;
+  (*list->go)();
+
+  vmeSimStart();
+  vmeSimResetStats();
+
+  tstart = benchNow();
+  for(itrig = 0; itrig < ntrig; itrig++)
+    {
+      vmeSimParams_t p;
+
+      vmeSimGetParams(&p);
+      if(p.trigger_rate == 0)
+	vmeSimTrigger(1);
+
+      if(vmeSimWaitTrigger(1000) != 1)
+	{
+	  ntimeout++;
+	  continue;
+	}
+
+      *list->dabufp = dataBuffer;
+      t0 = benchNow();
+      (*list->trigger)(itrig + 1);
+      t1 = benchNow();
+
+      latency[nlat++] = t1 - t0;
+      sumlat += t1 - t0;
+      nwords += (*list->dabufp - dataBuffer);
+    }
+  tstop = benchNow();
+
+  vmeSimGetStats(&stats);
+
+  rol->daproc = DA_END_PROC;
+  (*list->end)();
+
+  qsort(latency, nlat, sizeof(uint64_t), cmp_u64);
+  elapsed = (tstop - tstart) * 1e-9;
+
+  printf("\n");
+  printf("bench_readout: %s  %u blocks (%u timeouts) in %.3f s\n",
+	 runtype, nlat, ntimeout, elapsed);
+  printf("  blocks/s        %12.1f\n", nlat / elapsed);
+  printf("  words/s         %12.1f  (%.1f words/block)\n",
+	 nwords / elapsed, nlat ? (double)nwords / nlat : 0.);
+  printf("  latency (us)    p50 %8.2f   p99 %8.2f   p99.9 %8.2f   max %8.2f\n",
+	 percentile(latency, nlat, 0.5), percentile(latency, nlat, 0.99),
+	 percentile(latency, nlat, 0.999), percentile(latency, nlat, 1.0));
+
+  printf("  modelled bus time per block (us):\n");
+  for(stage = 0; stage < VMESIM_NSTAGE; stage++)
+    {
+      if(stats.ncalls[stage] == 0)
+	continue;
+      bus_ns += stats.ns[stage];
+      printf("    %-20s %10.2f   (%llu calls, %llu words)\n",
+	     vmeSimStageName(stage),
+	     nlat ? stats.ns[stage] / 1000. / nlat : 0.,
+	     (unsigned long long)stats.ncalls[stage],
+	     (unsigned long long)stats.nwords[stage]);
+    }
+  printf("    %-20s %10.2f\n", "TI block",
+	 nlat ? (stats.ns[VMESIM_TI_READ]) / 1000. / nlat : 0.);
+  printf("    %-20s %10.2f\n", "helicity bank",
+	 nlat ? (stats.ns[VMESIM_HD_BREADY] + stats.ns[VMESIM_HD_READ]) / 1000. / nlat : 0.);
+  printf("    %-20s %10.2f\n", "FADC bank",
+	 nlat ? (stats.ns[VMESIM_FA_BREADY] + stats.ns[VMESIM_FA_READ]) / 1000. / nlat : 0.);
+  printf("    %-20s %10.2f\n", "software",
+	 nlat ? ((double)sumlat - bus_ns) / 1000. / nlat : 0.);
+
+  free(latency);
+  return 0;
+}
+
+int32_t
+main(int32_t argc, char *argv[])
+{
+  const char *listname = "../uitf_list_sim.so";
+  const char *config = "uitf_mott.cfg";
+  const char *mode = "both";
+  uint32_t ntrig = 10000;
+  char configpath[PATH_MAX];
+  benchList_t list;
+  ROLPARAMS rolp;
+  int opt;
+
+  while((opt = getopt(argc, argv, "n:m:c:l:r:h")) != -1)
+    {
+      switch(opt)
+	{
+	case 'n':
+	  ntrig = strtoul(optarg, NULL, 0);
+	  break;
+	case 'm':
+	  mode = optarg;
+	  break;
+	case 'c':
+	  config = optarg;
+	  break;
+	case 'l':
+	  listname = optarg;
+	  break;
+	case 'r':
+	  {
+	    vmeSimParams_t p;
+	    vmeSimGetParams(&p);
+	    p.trigger_rate = strtod(optarg, NULL);
+	    vmeSimSetParams(&p);
+	  }
+	  break;
+	default:
+	  printf("Usage: %s [-n ntrig] [-m counting|integrating|both]"
+		 " [-c configfile] [-l readout_list.so] [-r rate_hz]\n", argv[0]);
+	  return (opt == 'h') ? 0 : -1;
+	}
+    }
+
+  if(realpath(config, configpath) == NULL)
+    {
+      printf("%s: ERROR: config file %s not found\n", argv[0], config);
+      return -1;
+    }
+
+  if(benchLoad(listname, &list) != 0)
+    return -1;
+
+  memset(&rolp, 0, sizeof(rolp));
+  rolp.listName = "bench_readout";
+  rolp.usrConfig = configpath;
+  rolp.usrString = "";
+  rolp.runNumber = 1;
+  rolp.dabufp = (void *)userBuffer;
+  rolp.daproc = DA_INIT_PROC;
+  (*list.init)(&rolp);
+
+  if((strcasecmp(mode, "counting") == 0) || (strcasecmp(mode, "both") == 0))
+    benchRun(&list, &rolp, "counting", ntrig);
+
+  if((strcasecmp(mode, "integrating") == 0) || (strcasecmp(mode, "both") == 0))
+    benchRun(&list, &rolp, "integrating", ntrig);
+
+  dlclose(list.handle);
+
+  return 0;
+}
+/*
+  Local Variables:
+  compile-command: "make -k bench_readout "
+  End:
+*/
@@ -0,0 +1,156 @@
+/*
+ * File:
+ *    testAsym.c
+ *
+ * Description:
+ *    Check the SIMD asymmetry kernels (SSE2, AVX2 where the CPU has it)
+ *    against the plain C ones, bit for bit, on random yields, and the
+ *    summary of one octet with a known asymmetry.
+ *
+ *    Runs off the crate: no VME libraries.
+ *
+ */
+
+#include <stdlib.h>
+#include "../uitf_asym.c"
+
+#define NCASE 20000
+
+static uint32_t seed = 0x6c078965;
+
+static uint32_t
+testRandom()
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/* Each kernel against the C kernel.  Returns the mismatches */
+static int32_t
+testKernels(const uitf_asym_kernels_t *k)
+{
+  static uint32_t y[UITF_ASYM_MAXCHAN];
+  static double pos[UITF_ASYM_MAXCHAN], neg[UITF_ASYM_MAXCHAN];
+  static double c[4][UITF_ASYM_MAXCHAN], v[4][UITF_ASYM_MAXCHAN];
+  int32_t icase, i, n, nbad = 0;
+
+  for(icase = 0; icase < NCASE; icase++)
+    {
+      /* Short rows (the scalar tails) and whole crates */
+      n = 1 + (testRandom() % ((icase & 1) ? 7 : UITF_ASYM_MAXCHAN));
+      for(i = 0; i < n; i++)
+	{
+	  y[i] = testRandom() & 0x7ffff;
+	  /* Some empty channels: a zero sum */
+	  pos[i] = (testRandom() & 7) ? (double)(testRandom() & 0x3ffffff) : 0;
+	  neg[i] = (pos[i] != 0) ? (double)(testRandom() & 0x3ffffff) : 0;
+	  c[0][i] = v[0][i] = (double)(testRandom() & 0xffff);
+	  c[1][i] = v[1][i] = (double)testRandom() / 0xffffffffu;
+	  c[2][i] = v[2][i] = (double)testRandom() / 0xffffffffu;
+	  c[3][i] = v[3][i] = (double)(testRandom() & 0xffffff);
+	}
+
+      asymKernelsC.add(c[0], y, n);
+      k->add(v[0], y, n);
+      asymKernelsC.pattern(pos, neg, c[1], c[2], c[3], n);
+      k->pattern(pos, neg, v[1], v[2], v[3], n);
+
+      if(memcmp(c[0], v[0], n * sizeof(double)) != 0)
+	{
+	  printf("%s: %s add differs, %d channels\n", __func__, k->name, n);
+	  nbad++;
+	}
+      if((memcmp(c[1], v[1], n * sizeof(double)) != 0) ||
+	 (memcmp(c[2], v[2], n * sizeof(double)) != 0) ||
+	 (memcmp(c[3], v[3], n * sizeof(double)) != 0))
+	{
+	  printf("%s: %s pattern differs, %d channels\n", __func__, k->name, n);
+	  nbad++;
+	}
+    }
+
+  printf("%s: %-4s %d cases, %d mismatches\n", __func__, k->name, NCASE, nbad);
+
+  return nbad;
+}
+
+/* One octet (+ - - + - + + -), one fadc250 in slot 3.  Channel 0 has
+   110 in + windows and 90 in -: asymmetry 80 / 800 */
+static int32_t
+testOctet()
+{
+  static const uint8_t hel[8] = {1, 0, 0, 1, 0, 1, 1, 0};
+  uint32_t hd[32], fa[32], buf[UITF_ASYM_MAXWORDS(1)], slot = 3;
+  int32_t iev, nhd = 0, nfa = 0, nw, nbad = 0;
+  float mean, yield;
+
+  if(uitfAsymInit(2, &slot, 1) != 0)
+    return 1;
+
+  fa[nfa++] = 0x80000000 | (slot << 22) | 8;	/* block header */
+  for(iev = 0; iev < 8; iev++)
+    {
+      hd[nhd++] = 0x90000000 | (iev + 1);	/* event header */
+      hd[nhd++] = 0xc0000000 | ((iev == 0) << 1) | hel[iev];
+      fa[nfa++] = 0x90000000 | (iev + 1);
+      fa[nfa++] = 0xb8000000 | (hel[iev] ? 110 : 90);	/* integral, ch 0 */
+    }
+
+  if(uitfAsymBlock(hd, nhd, fa, nfa) != 8)
+    {
+      printf("%s: block not used\n", __func__);
+      return 1;
+    }
+
+  nw = uitfAsymFill(buf, UITF_ASYM_MAXWORDS(1));
+  if(nw != UITF_ASYM_MAXWORDS(1))
+    {
+      printf("%s: %d words, not %d\n", __func__, nw, UITF_ASYM_MAXWORDS(1));
+      return 1;
+    }
+  if((buf[1] != 1) || (buf[2] != 0) || (buf[3] != 0))
+    {
+      printf("%s: patterns used %d, bad %d, mismatched blocks %d\n", __func__,
+	     buf[1], buf[2], buf[3]);
+      nbad++;
+    }
+
+  memcpy(&mean, &buf[UITF_ASYM_HEADER], sizeof(mean));
+  memcpy(&yield, &buf[UITF_ASYM_HEADER + 2], sizeof(yield));
+  if((mean != (float)(80.0 / 800.0)) || (yield != 800.0f))
+    {
+      printf("%s: channel 0 asymmetry %g, yield %g\n", __func__, mean, yield);
+      nbad++;
+    }
+
+  printf("%s: %d mismatches\n", __func__, nbad);
+
+  return nbad;
+}
+
+int32_t
+main(int32_t argc, char *argv[])
+{
+  int32_t nbad = 0;
+
+#ifdef UITF_ASYM_X86
+  nbad += testKernels(&asymKernelsSse2);
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    nbad += testKernels(&asymKernelsAvx2);
+  else
+    printf("main: no AVX2 on this CPU.  AVX2 kernels not tested\n");
+#endif
+  nbad += testOctet();
+
+  printf("testAsym: %s\n", nbad ? "FAILED" : "OK");
+
+  return nbad ? 1 : 0;
+}
+/*
+  Local Variables:
+  compile-command: "make -k testAsym "
+  End:
+*/
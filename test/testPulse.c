@@ -0,0 +1,182 @@
+/*
+ * File:
+ *    testPulse.c
+ *
+ * Description:
+ *    Check the SIMD pulse kernels (SSE2, AVX2 where the CPU has it)
+ *    against the plain C ones, on random windows, and the pulse
+ *    parameter words of a window with a known pulse.
+ *
+ *    Runs off the crate: no VME libraries.
+ *
+ */
+
+#include <stdlib.h>
+#include "../uitf_pulse.c"
+
+#define NCASE 20000
+
+static uint32_t seed = 0x2545f491;
+
+static uint32_t
+testRandom()
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/* Each kernel against the C kernel.  Returns the mismatches */
+static int32_t
+testKernels(const uitf_pulse_kernels_t *k)
+{
+  static uint32_t w[UITF_PULSE_MAXPTW / 2];
+  static int16_t sc[UITF_PULSE_MAXPTW + 16], sk[UITF_PULSE_MAXPTW + 16];
+  int32_t icase, iw, nw, ns, off, nbad = 0;
+  int16_t thr;
+
+  for(icase = 0; icase < NCASE; icase++)
+    {
+      /* Short windows (the scalar tails) and long ones */
+      nw = 1 + (testRandom() % ((icase & 1) ? 40 : (UITF_PULSE_MAXPTW / 2)));
+      ns = 2 * nw;
+      for(iw = 0; iw < nw; iw++)
+	w[iw] = testRandom();
+
+      pulseKernelsC.unpack(w, sc, nw);
+      k->unpack(w, sk, nw);
+      if(memcmp(sc, sk, ns * sizeof(int16_t)) != 0)
+	{
+	  printf("%s: %s unpack differs, %d words\n", __func__, k->name, nw);
+	  nbad++;
+	  continue;
+	}
+
+      off = testRandom() % ns;
+      thr = testRandom() & 0xfff;
+
+      if(pulseKernelsC.sum(sc + off, ns - off) != k->sum(sc + off, ns - off))
+	{
+	  printf("%s: %s sum differs, %d samples\n", __func__, k->name, ns - off);
+	  nbad++;
+	}
+      if(pulseKernelsC.above(sc + off, ns - off, thr) != k->above(sc + off, ns - off, thr))
+	{
+	  printf("%s: %s above differs, %d samples, threshold %d\n", __func__,
+		 k->name, ns - off, thr);
+	  nbad++;
+	}
+      if(pulseKernelsC.peak(sc + off, ns - off) != k->peak(sc + off, ns - off))
+	{
+	  printf("%s: %s peak differs, %d samples\n", __func__, k->name, ns - off);
+	  nbad++;
+	}
+    }
+
+  printf("%s: %-4s %d windows, %d mismatches\n", __func__, k->name, NCASE, nbad);
+
+  return nbad;
+}
+
+/* One block: a 64 sample window, pedestal 100, a pulse of 900 at sample 30 */
+static int32_t
+testBlock()
+{
+  uitf_pulse_board_t board;
+  uint32_t in[64], out[64];
+  int16_t s[64];
+  int32_t i, nin = 0, nout, nbad = 0;
+  uint32_t ped4, integral = 0;
+
+  memset(&board, 0, sizeof(board));
+  board.slot = 3;
+  board.nsb = 2;
+  board.nsa = 5;
+  board.np = 1;
+  for(i = 0; i < UITF_PULSE_NCHAN; i++)
+    board.threshold[i] = 50;
+
+  for(i = 0; i < 64; i++)
+    s[i] = 100;
+  s[29] = 500;
+  s[30] = 900;
+  s[31] = 1000;
+  s[32] = 600;
+  s[33] = 200;
+
+  in[nin++] = 0x80000000 | (3 << 22) | (1 << 8) | 1;	/* block header */
+  in[nin++] = 0x90000000 | 7;				/* event header */
+  in[nin++] = 0xa0000000 | (5 << 23) | 64;		/* raw window, ch 5 */
+  for(i = 0; i < 64; i += 2)
+    in[nin++] = (s[i] << 16) | s[i + 1];
+  in[nin] = 0x88000000 | (3 << 22) | (nin + 1);		/* block trailer */
+  nin++;
+
+  if(uitfPulseInit(&board, 1) != 0)
+    return 1;
+
+  nout = uitfPulseBlock(in, nin, out, 64);
+
+  ped4 = 4 * 100;
+  for(i = 29 - 2; i <= 29 + 5; i++)
+    integral += s[i];
+
+  /* header, event header, 3 pulse words, trailer */
+  if(nout != 6)
+    {
+      printf("%s: %d words out, not 6\n", __func__, nout);
+      return 1;
+    }
+  if(out[2] != (0xc8000000 | (1 << 19) | (5 << 15) | ped4))
+    {
+      printf("%s: pulse word 1 0x%08x\n", __func__, out[2]);
+      nbad++;
+    }
+  /* 5 samples over 150 from the crossing (29) to the end of nsa (34) */
+  if(out[3] != ((1 << 30) | (integral << 12) | 5))
+    {
+      printf("%s: pulse word 2 0x%08x (integral %d)\n", __func__, out[3], integral);
+      nbad++;
+    }
+  /* Half height 550: between 500 (29) and 900 (30), at 29 + 50/400 */
+  if(out[4] != (((29 * 64 + 8) << 15) | 1000))
+    {
+      printf("%s: pulse word 3 0x%08x\n", __func__, out[4]);
+      nbad++;
+    }
+  if((out[5] & 0xf83fffff) != (0x88000000 | 6))
+    {
+      printf("%s: trailer 0x%08x\n", __func__, out[5]);
+      nbad++;
+    }
+
+  printf("%s: %d mismatches\n", __func__, nbad);
+
+  return nbad;
+}
+
+int32_t
+main(int32_t argc, char *argv[])
+{
+  int32_t nbad = 0;
+
+#ifdef UITF_PULSE_X86
+  nbad += testKernels(&pulseKernelsSse2);
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2"))
+    nbad += testKernels(&pulseKernelsAvx2);
+  else
+    printf("main: no AVX2 on this CPU.  AVX2 kernels not tested\n");
+#endif
+  nbad += testBlock();
+
+  printf("testPulse: %s\n", nbad ? "FAILED" : "OK");
+
+  return nbad ? 1 : 0;
+}
+/*
+  Local Variables:
+  compile-command: "make -k testPulse "
+  End:
+*/
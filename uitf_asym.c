@@ -0,0 +1,519 @@
+/*************************************************************************
+ *
+ *  uitf_asym.c - Helicity-correlated yields and asymmetries, in the ROC
+ *
+ *    The decoded block is kept as one row of channel sums per event, so
+ *    the pattern sums run over contiguous channel arrays, with SIMD
+ *    kernels: AVX2 where the CPU has it (checked at uitfAsymInit), SSE2
+ *    on other x86_64, and plain C elsewhere.  The kernels give the same
+ *    sums, bit for bit.  A pattern starts at a window with pattern sync,
+ *    and is used if it has the full number of windows, half of them +.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "uitf_asym.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define UITF_ASYM_X86 1
+#endif
+
+#define UITF_ASYM_TYPE(w)  (((w) >> 27) & 0xf)
+#define UITF_ASYM_DEFINE   0x80000000
+enum
+  {
+    UITF_ASYM_BLOCK_HEADER = 0,
+    UITF_ASYM_EVENT_HEADER = 2,
+    UITF_ASYM_PULSE_INTEG = 7,
+    UITF_ASYM_HD_DECODER = 8
+  };
+
+/* Windows per pattern, by helicity pattern: pair, quartet, octet, toggle */
+static const uint32_t asymPatternWindows[4] = {2, 4, 8, 2};
+
+static uint32_t asymNwin = 8;
+static int32_t asymNboard = 0, asymNchan = 0;
+static int8_t asymBoard[32];	/* by slot, -1 if not read */
+
+/* This block */
+static uint8_t asymHel[UITF_ASYM_MAXEV], asymSync[UITF_ASYM_MAXEV];
+static uint32_t asymYield[UITF_ASYM_MAXEV][UITF_ASYM_MAXCHAN];
+
+/* Pattern in progress */
+static double asymPos[UITF_ASYM_MAXCHAN], asymNeg[UITF_ASYM_MAXCHAN];
+static uint32_t asymWin = 0, asymNpos = 0, asymStarted = 0;
+
+/* This interval */
+static double asymSumA[UITF_ASYM_MAXCHAN], asymSumA2[UITF_ASYM_MAXCHAN];
+static double asymSumY[UITF_ASYM_MAXCHAN];
+static uint32_t asymGood = 0, asymBad = 0, asymMismatch = 0;
+static uint64_t asymStart = 0, asymNext = 0;
+
+/* This run */
+static uint64_t asymRunGood = 0, asymRunBad = 0, asymRunMismatch = 0;
+
+static uint64_t
+uitfAsymNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+typedef struct
+{
+  const char *name;
+  void (*add)(double *acc, const uint32_t *y, int32_t n);
+  void (*pattern)(const double *pos, const double *neg,
+		  double *sa, double *sa2, double *sy, int32_t n);
+} uitf_asym_kernels_t;
+
+/*************************************************************************
+ *  Kernels: plain C
+ */
+
+/* acc[i] += y[i] */
+static void
+uitfAsymAddC(double *restrict acc, const uint32_t *restrict y, int32_t n)
+{
+  int32_t i;
+
+  for(i = 0; i < n; i++)
+    acc[i] += y[i];
+}
+
+/* Asymmetry of one pattern, per channel, added to the interval sums.
+   Yields are not negative, so a zero sum also has a zero difference */
+static void
+uitfAsymPatternC(const double *restrict pos, const double *restrict neg,
+		 double *restrict sa, double *restrict sa2,
+		 double *restrict sy, int32_t n)
+{
+  int32_t i;
+
+  for(i = 0; i < n; i++)
+    {
+      double s = pos[i] + neg[i], d = pos[i] - neg[i];
+      double a = d / ((s > 0) ? s : 1.0);
+
+      sa[i] += a;
+      sa2[i] += a * a;
+      sy[i] += s;
+    }
+}
+
+static const uitf_asym_kernels_t asymKernelsC =
+  {
+    "C", uitfAsymAddC, uitfAsymPatternC
+  };
+
+#ifdef UITF_ASYM_X86
+/*************************************************************************
+ *  Kernels: SSE2 (every x86_64).  The yields are 19 bit integrals, so
+ *  the signed conversion is exact
+ */
+
+static void
+uitfAsymAddSse2(double *acc, const uint32_t *y, int32_t n)
+{
+  int32_t i = 0;
+
+  for(; i + 2 <= n; i += 2)
+    {
+      __m128d v = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)(y + i)));
+
+      _mm_storeu_pd(acc + i, _mm_add_pd(_mm_loadu_pd(acc + i), v));
+    }
+  uitfAsymAddC(acc + i, y + i, n - i);
+}
+
+static void
+uitfAsymPatternSse2(const double *pos, const double *neg,
+		    double *sa, double *sa2, double *sy, int32_t n)
+{
+  const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0);
+  int32_t i = 0;
+
+  for(; i + 2 <= n; i += 2)
+    {
+      __m128d p = _mm_loadu_pd(pos + i), m = _mm_loadu_pd(neg + i);
+      __m128d s = _mm_add_pd(p, m), d = _mm_sub_pd(p, m);
+      __m128d gt = _mm_cmpgt_pd(s, zero);
+      __m128d a = _mm_div_pd(d, _mm_or_pd(_mm_and_pd(gt, s), _mm_andnot_pd(gt, one)));
+
+      _mm_storeu_pd(sa + i, _mm_add_pd(_mm_loadu_pd(sa + i), a));
+      _mm_storeu_pd(sa2 + i, _mm_add_pd(_mm_loadu_pd(sa2 + i), _mm_mul_pd(a, a)));
+      _mm_storeu_pd(sy + i, _mm_add_pd(_mm_loadu_pd(sy + i), s));
+    }
+  uitfAsymPatternC(pos + i, neg + i, sa + i, sa2 + i, sy + i, n - i);
+}
+
+static const uitf_asym_kernels_t asymKernelsSse2 =
+  {
+    "SSE2", uitfAsymAddSse2, uitfAsymPatternSse2
+  };
+
+/*************************************************************************
+ *  Kernels: AVX2.  No FMA, so a * a is rounded as in the C kernel
+ */
+
+__attribute__((target("avx2"))) static void
+uitfAsymAddAvx2(double *acc, const uint32_t *y, int32_t n)
+{
+  int32_t i = 0;
+
+  for(; i + 4 <= n; i += 4)
+    {
+      __m256d v = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(y + i)));
+
+      _mm256_storeu_pd(acc + i, _mm256_add_pd(_mm256_loadu_pd(acc + i), v));
+    }
+  uitfAsymAddSse2(acc + i, y + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+uitfAsymPatternAvx2(const double *pos, const double *neg,
+		    double *sa, double *sa2, double *sy, int32_t n)
+{
+  const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+  int32_t i = 0;
+
+  for(; i + 4 <= n; i += 4)
+    {
+      __m256d p = _mm256_loadu_pd(pos + i), m = _mm256_loadu_pd(neg + i);
+      __m256d s = _mm256_add_pd(p, m), d = _mm256_sub_pd(p, m);
+      __m256d gt = _mm256_cmp_pd(s, zero, _CMP_GT_OQ);
+      __m256d a = _mm256_div_pd(d, _mm256_blendv_pd(one, s, gt));
+
+      _mm256_storeu_pd(sa + i, _mm256_add_pd(_mm256_loadu_pd(sa + i), a));
+      _mm256_storeu_pd(sa2 + i, _mm256_add_pd(_mm256_loadu_pd(sa2 + i), _mm256_mul_pd(a, a)));
+      _mm256_storeu_pd(sy + i, _mm256_add_pd(_mm256_loadu_pd(sy + i), s));
+    }
+  uitfAsymPatternSse2(pos + i, neg + i, sa + i, sa2 + i, sy + i, n - i);
+}
+
+static const uitf_asym_kernels_t asymKernelsAvx2 =
+  {
+    "AVX2", uitfAsymAddAvx2, uitfAsymPatternAvx2
+  };
+#endif /* UITF_ASYM_X86 */
+
+static const uitf_asym_kernels_t *asymK = &asymKernelsC;
+
+static void
+uitfAsymPatternStart()
+{
+  memset(asymPos, 0, asymNchan * sizeof(double));
+  memset(asymNeg, 0, asymNchan * sizeof(double));
+  asymWin = 0;
+  asymNpos = 0;
+  asymStarted = 1;
+}
+
+static void
+uitfAsymPatternEnd()
+{
+  if((asymWin == asymNwin) && ((asymNpos << 1) == asymNwin))
+    {
+      asymK->pattern(asymPos, asymNeg, asymSumA, asymSumA2, asymSumY, asymNchan);
+      asymGood++;
+      asymRunGood++;
+    }
+  else
+    {
+      asymBad++;
+      asymRunBad++;
+    }
+  asymStarted = 0;
+}
+
+/**
+ * @details Set the pattern and the fadc250s to sum, and clear the sums
+ * @param[in] helicity_pattern 0 pair, 1 quartet, 2 octet, 3 toggle
+ * @param[in] slots Slot of each fadc250, in bank order
+ * @param[in] nboard Number of fadc250s
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+uitfAsymInit(uint32_t helicity_pattern, const uint32_t *slots, int32_t nboard)
+{
+  int32_t iboard;
+
+  if((helicity_pattern > 3) || (nboard <= 0) || (nboard > UITF_ASYM_MAXBOARD))
+    {
+      printf("%s: ERROR: Invalid pattern (%d) or fadc250s (%d)\n",
+	     __func__, helicity_pattern, nboard);
+      return -1;
+    }
+
+  asymNwin = asymPatternWindows[helicity_pattern];
+  asymNboard = nboard;
+  asymNchan = nboard * UITF_ASYM_NCHAN;
+
+  memset(asymBoard, -1, sizeof(asymBoard));
+  for(iboard = 0; iboard < nboard; iboard++)
+    asymBoard[slots[iboard] & 0x1f] = iboard;
+
+#ifdef UITF_ASYM_X86
+  __builtin_cpu_init();
+  asymK = __builtin_cpu_supports("avx2") ? &asymKernelsAvx2 : &asymKernelsSse2;
+#else
+  asymK = &asymKernelsC;
+#endif
+
+  printf("%s: %d window patterns, %d channels, %s kernels\n", __func__,
+	 asymNwin, asymNchan, asymK->name);
+
+  uitfAsymReset();
+
+  return 0;
+}
+
+/**
+ * @details Clear the sums and the pattern in progress, and restart the
+ *          uitfAsymDue interval
+ */
+void
+uitfAsymReset()
+{
+  memset(asymSumA, 0, sizeof(asymSumA));
+  memset(asymSumA2, 0, sizeof(asymSumA2));
+  memset(asymSumY, 0, sizeof(asymSumY));
+  asymGood = asymBad = asymMismatch = 0;
+  asymRunGood = asymRunBad = asymRunMismatch = 0;
+  asymStarted = 0;
+  asymStart = uitfAsymNow();
+  asymNext = 0;
+}
+
+/* Helicity and pattern sync of each event.  Returns the number of events */
+static int32_t
+uitfAsymDecodeHd(volatile uint32_t *hd, int32_t nwords)
+{
+  int32_t iw, nev = 0;
+  uint32_t w;
+
+  for(iw = 0; iw < nwords; iw++)
+    {
+      w = hd[iw];
+      if(!(w & UITF_ASYM_DEFINE))
+	continue;
+
+      switch(UITF_ASYM_TYPE(w))
+	{
+	case UITF_ASYM_EVENT_HEADER:
+	  if(nev == UITF_ASYM_MAXEV)
+	    return -1;
+	  asymHel[nev] = 0;
+	  asymSync[nev] = 0;
+	  nev++;
+	  break;
+
+	case UITF_ASYM_HD_DECODER:
+	  if(nev > 0)
+	    {
+	      asymHel[nev - 1] = w & 0x1;
+	      asymSync[nev - 1] = (w >> 1) & 0x1;
+	    }
+	  break;
+	}
+    }
+
+  return nev;
+}
+
+/* Integrating sums of each event, by board and channel.
+   Returns 0 if every board has nev events, otherwise -1 */
+static int32_t
+uitfAsymDecodeFa(volatile uint32_t *fa, int32_t nwords, int32_t nev)
+{
+  int32_t iw, iev = -1, iboard = -1, nboard = 0, bad = 0;
+  uint32_t w;
+
+  for(iev = 0; iev < nev; iev++)
+    memset(asymYield[iev], 0, asymNchan * sizeof(uint32_t));
+  iev = -1;
+
+  for(iw = 0; iw < nwords; iw++)
+    {
+      w = fa[iw];
+      if(!(w & UITF_ASYM_DEFINE))
+	continue;
+
+      switch(UITF_ASYM_TYPE(w))
+	{
+	case UITF_ASYM_BLOCK_HEADER:
+	  if((iboard >= 0) && (iev + 1 != nev))
+	    bad = 1;
+	  iboard = asymBoard[(w >> 22) & 0x1f];
+	  iev = -1;
+	  nboard++;
+	  break;
+
+	case UITF_ASYM_EVENT_HEADER:
+	  iev++;
+	  break;
+
+	case UITF_ASYM_PULSE_INTEG:
+	  if((iboard >= 0) && (iev >= 0) && (iev < nev))
+	    asymYield[iev][iboard * UITF_ASYM_NCHAN + ((w >> 23) & 0xf)] = w & 0x7ffff;
+	  break;
+	}
+    }
+  if((iboard >= 0) && (iev + 1 != nev))
+    bad = 1;
+
+  return (bad || (nboard != asymNboard)) ? -1 : 0;
+}
+
+/**
+ * @details Add the events of a block to the helicity pattern sums
+ * @param[in] hd Helicity decoder block (bank contents)
+ * @param[in] hdwords Words in the helicity decoder block
+ * @param[in] fa fadc250 blocks (bank contents)
+ * @param[in] fawords Words in the fadc250 blocks
+ * @return Events in the block, or -1 if the helicity decoder and
+ *         fadc250 blocks do not have the same events (not used)
+ */
+int32_t
+uitfAsymBlock(volatile uint32_t *hd, int32_t hdwords,
+	      volatile uint32_t *fa, int32_t fawords)
+{
+  int32_t nev, iev;
+
+  if(asymNchan == 0)
+    return -1;
+
+  nev = uitfAsymDecodeHd(hd, hdwords);
+  if((nev <= 0) || (uitfAsymDecodeFa(fa, fawords, nev) != 0))
+    {
+      /* The pattern in progress has lost windows */
+      asymStarted = 0;
+      asymMismatch++;
+      asymRunMismatch++;
+      return -1;
+    }
+
+  for(iev = 0; iev < nev; iev++)
+    {
+      if(asymSync[iev])
+	{
+	  if(asymStarted)
+	    uitfAsymPatternEnd();
+	  uitfAsymPatternStart();
+	}
+      if(!asymStarted)
+	continue;
+
+      asymK->add(asymHel[iev] ? asymPos : asymNeg, asymYield[iev], asymNchan);
+      asymNpos += asymHel[iev];
+      asymWin++;
+
+      if(asymWin == asymNwin)
+	uitfAsymPatternEnd();
+    }
+
+  return nev;
+}
+
+/**
+ * @details Check if a summary is due
+ * @param[in] interval_s Seconds between summaries (0: never)
+ * @return 1 if interval_s has passed since the last one, otherwise 0
+ */
+int32_t
+uitfAsymDue(uint32_t interval_s)
+{
+  uint64_t now;
+
+  if((interval_s == 0) || (asymNchan == 0))
+    return 0;
+
+  now = uitfAsymNow();
+  if(asymNext == 0)
+    asymNext = asymStart + interval_s * 1000000000ULL;
+
+  if(now < asymNext)
+    return 0;
+
+  asymNext = now + interval_s * 1000000000ULL;
+  return 1;
+}
+
+static uint32_t
+uitfAsymFloat(double x)
+{
+  float f = (float)x;
+  uint32_t w;
+
+  memcpy(&w, &f, sizeof(w));
+  return w;
+}
+
+/**
+ * @details Pack the sums since the last summary, and clear them
+ *            word 0: version << 24 | windows per pattern << 16 | channels
+ *            word 1: patterns used
+ *            word 2: incomplete or unbalanced patterns
+ *            word 3: blocks with helicity decoder / fadc250 event mismatch
+ *            word 4: time since the last summary (ms)
+ *            per channel: mean asymmetry, rms, mean pattern yield (float)
+ * @param[out] buf Where to write
+ * @param[in] maxwords Space in buf
+ * @return Words written, or -1 if buf is too small
+ */
+int32_t
+uitfAsymFill(volatile uint32_t *buf, int32_t maxwords)
+{
+  int32_t ichan, iw = 0;
+  uint64_t now = uitfAsymNow();
+  double n = asymGood ? (double)asymGood : 1.0;
+
+  if(maxwords < UITF_ASYM_MAXWORDS(asymNboard))
+    return -1;
+
+  buf[iw++] = (UITF_ASYM_VERSION << 24) | (asymNwin << 16) | asymNchan;
+  buf[iw++] = asymGood;
+  buf[iw++] = asymBad;
+  buf[iw++] = asymMismatch;
+  buf[iw++] = (now - asymStart) / 1000000;
+
+  for(ichan = 0; ichan < asymNchan; ichan++)
+    {
+      double mean = asymSumA[ichan] / n;
+      double var = asymSumA2[ichan] / n - mean * mean;
+
+      buf[iw++] = uitfAsymFloat(mean);
+      buf[iw++] = uitfAsymFloat((var > 0) ? sqrt(var) : 0);
+      buf[iw++] = uitfAsymFloat(asymSumY[ichan] / n);
+    }
+
+  memset(asymSumA, 0, sizeof(asymSumA));
+  memset(asymSumA2, 0, sizeof(asymSumA2));
+  memset(asymSumY, 0, sizeof(asymSumY));
+  asymGood = asymBad = asymMismatch = 0;
+  asymStart = now;
+
+  return iw;
+}
+
+/**
+ * @details Print the pattern counts of this run
+ */
+void
+uitfAsymPrint()
+{
+  if(asymNchan == 0)
+    return;
+
+  printf("%s: Helicity patterns: %llu used, %llu incomplete or unbalanced\n",
+	 __func__, (unsigned long long)asymRunGood, (unsigned long long)asymRunBad);
+  if(asymRunMismatch)
+    printf("%s: Blocks with HD / FADC event mismatch: %llu\n",
+	   __func__, (unsigned long long)asymRunMismatch);
+}
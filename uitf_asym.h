@@ -0,0 +1,35 @@
+#pragma once
+/*************************************************************************
+ *
+ *  uitf_asym.h - Helicity-correlated yields and asymmetries, in the ROC
+ *
+ *    Each block, the helicity decoder words (helicity, pattern sync) and
+ *    the fadc250 pulse integrals (mode 3 or 7) of every event are
+ *    decoded, and summed over the + and - windows of each helicity
+ *    pattern.  Per channel
+ *    asymmetry sums of the complete patterns are packed into a summary
+ *    bank (uitfAsymFill) every readout.asym_interval seconds.
+ *
+ */
+
+#include <stdint.h>
+
+#define UITF_ASYM_NCHAN    16	/* per fadc250 */
+#define UITF_ASYM_MAXBOARD 20
+#define UITF_ASYM_MAXCHAN  (UITF_ASYM_NCHAN * UITF_ASYM_MAXBOARD)
+#define UITF_ASYM_MAXEV    256	/* events per block */
+#define UITF_ASYM_VERSION  1
+
+/* Summary bank words: header, then mean asymmetry, its rms and the mean
+   pattern yield (IEEE floats) per channel */
+#define UITF_ASYM_HEADER   5
+#define UITF_ASYM_MAXWORDS(nboard) \
+  (UITF_ASYM_HEADER + 3 * UITF_ASYM_NCHAN * (nboard))
+
+int32_t uitfAsymInit(uint32_t helicity_pattern, const uint32_t *slots, int32_t nboard);
+void    uitfAsymReset();
+int32_t uitfAsymBlock(volatile uint32_t *hd, int32_t hdwords,
+		      volatile uint32_t *fa, int32_t fawords);
+int32_t uitfAsymDue(uint32_t interval_s);
+int32_t uitfAsymFill(volatile uint32_t *buf, int32_t maxwords);
+void    uitfAsymPrint();
@@ -7,9 +7,17 @@
  *
  */
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <libconfig.h>
 
 #include "uitf_config.h"
@@ -23,7 +31,275 @@ config_t uitfCfg;
 
 ti_config_t ti_params;
 hd_config_t hd_params;
-fadc_config_t fadc_params[2];
+readout_config_t readout_params;
+
+/* fadc250s, in config file order.  Storage grows with the config */
+fadc_config_t *fadc_params = NULL;
+int32_t uitf_nfadc = 0;
+static int32_t uitf_fadc_alloc = 0;
+
+/* Hash (FNV-1a) of the config file read by uitf_config_init */
+static uint64_t uitf_config_hash = 0;
+
+/* FNV-1a, continued from hash */
+static uint64_t
+uitf_config_fnv1a(uint64_t hash, const void *data, size_t n)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  size_t i;
+
+  for(i = 0; i < n; i++)
+    {
+      hash ^= p[i];
+      hash *= 0x100000001b3ULL;
+    }
+
+  return hash;
+}
+
+#define UITF_FNV1A_INIT 0xcbf29ce484222325ULL
+
+/**
+ * @details FNV-1a hash of a file
+ * @param[in] filename File to hash
+ * @return hash, or 0 if the file could not be read
+ */
+static uint64_t
+uitf_config_file_hash(const char *filename)
+{
+  uint64_t hash = UITF_FNV1A_INIT;
+  uint8_t buf[4096];
+  size_t n;
+  FILE *f = fopen(filename, "r");
+
+  if(f == NULL)
+    return 0;
+
+  while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    hash = uitf_config_fnv1a(hash, buf, n);
+
+  fclose(f);
+  return hash;
+}
+
+/* A32 2eSST267, unless the module's dma group says otherwise */
+static void
+uitf_config_dma_default(dma_config_t *dma)
+{
+  dma->addrmode = 2;
+  dma->datamode = 5;
+  dma->sstmode = 1;
+}
+
+/**
+ * @details Size the fadc250 storage, and set each board to defaults
+ * @param[in] nfadc Number of fadc250s (up to UITF_FADC_MAX)
+ * @return 0 if successful, otherwise -1
+ */
+static int32_t
+uitf_config_fadc_init(int32_t nfadc)
+{
+  int32_t ifa;
+
+  if((nfadc < 0) || (nfadc > UITF_FADC_MAX))
+    {
+      printf("%s: ERROR: %d fadc250s.  Max %d\n", __func__, nfadc, UITF_FADC_MAX);
+      return -1;
+    }
+
+  if(nfadc > uitf_fadc_alloc)
+    {
+      fadc_config_t *fa = realloc(fadc_params, nfadc * sizeof(fadc_config_t));
+      if(fa == NULL)
+	{
+	  printf("%s: ERROR: Unable to allocate %d fadc250s\n", __func__, nfadc);
+	  return -1;
+	}
+      fadc_params = fa;
+      uitf_fadc_alloc = nfadc;
+    }
+
+  uitf_nfadc = nfadc;
+  if(nfadc)
+    memset(fadc_params, 0, nfadc * sizeof(fadc_config_t));
+  for(ifa = 0; ifa < nfadc; ifa++)
+    uitf_config_dma_default(&fadc_params[ifa].dma);
+
+  return 0;
+}
+
+/* Binary image of the parsed config, written next to the config file
+   (filename + UITF_CONFIG_CACHE_SUFFIX) after a successful parse and
+   validation.  It is used instead of the config file while the file's
+   mtime, size, and hash match, and the layout of the param structs is
+   the same as when it was written.  Bump the version with any change to
+   the param structs that the layout hash does not see (a member that is
+   not in a schema, or a change of its meaning). */
+#define UITF_CONFIG_CACHE_MAGIC   0x55495446	/* "UITF" */
+#define UITF_CONFIG_CACHE_VERSION 4
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;		/* whole image, bytes */
+  uint32_t layout;		/* hash of the param struct layout */
+  int64_t  src_mtime_ns;
+  int64_t  src_size;
+  uint64_t src_hash;
+  uint64_t checksum;		/* FNV-1a of everything after the header */
+} uitf_config_cache_header_t;
+
+typedef struct
+{
+  uitf_config_cache_header_t header;
+  ti_config_t ti;
+  hd_config_t hd;
+  readout_config_t readout;
+  uint32_t nfadc;
+  uint32_t reserved;
+  fadc_config_t fadc[];		/* nfadc */
+} uitf_config_cache_t;
+
+static uint32_t uitf_config_cache_layout();
+
+static void
+uitf_config_cache_name(const char *filename, char *name, size_t n)
+{
+  snprintf(name, n, "%s%s", filename, UITF_CONFIG_CACHE_SUFFIX);
+}
+
+/**
+ * @details Fill the params from the cached image of a config file
+ * @param[in] filename Config filename
+ * @param[in] src stat of the config file
+ * @return 0 if the image is valid and was loaded, otherwise -1
+ */
+static int32_t
+uitf_config_cache_load(const char *filename, const struct stat *src)
+{
+  char name[PATH_MAX];
+  const uitf_config_cache_t *cache;
+  const uitf_config_cache_header_t *h;
+  struct stat st;
+  int32_t fd, rval = -1;
+  size_t size;
+  void *image;
+
+  uitf_config_cache_name(filename, name, sizeof(name));
+
+  fd = open(name, O_RDONLY);
+  if(fd < 0)
+    return -1;
+
+  if((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(uitf_config_cache_t)) ||
+     (st.st_size > (off_t)(sizeof(uitf_config_cache_t) + UITF_FADC_MAX * sizeof(fadc_config_t))))
+    {
+      close(fd);
+      return -1;
+    }
+  size = st.st_size;
+
+  image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(image == MAP_FAILED)
+    return -1;
+
+  cache = (const uitf_config_cache_t *)image;
+  h = &cache->header;
+
+  if((h->magic == UITF_CONFIG_CACHE_MAGIC) &&
+     (h->version == UITF_CONFIG_CACHE_VERSION) &&
+     (h->size == size) &&
+     (cache->nfadc <= UITF_FADC_MAX) &&
+     (size == sizeof(uitf_config_cache_t) + cache->nfadc * sizeof(fadc_config_t)) &&
+     (h->layout == uitf_config_cache_layout()) &&
+     (h->src_mtime_ns == (int64_t)src->st_mtim.tv_sec * 1000000000LL + src->st_mtim.tv_nsec) &&
+     (h->src_size == (int64_t)src->st_size) &&
+     (h->src_hash == uitf_config_hash) &&
+     (h->checksum == uitf_config_fnv1a(UITF_FNV1A_INIT, &cache->ti, size - sizeof(*h))) &&
+     (uitf_config_fadc_init(cache->nfadc) == 0))
+    {
+      ti_params = cache->ti;
+      hd_params = cache->hd;
+      readout_params = cache->readout;
+      memcpy(fadc_params, cache->fadc, cache->nfadc * sizeof(fadc_config_t));
+      rval = 0;
+    }
+
+  munmap(image, size);
+
+  return rval;
+}
+
+/**
+ * @details Write the params to the cached image of a config file
+ * @param[in] filename Config filename
+ * @param[in] src stat of the config file
+ * @return 0 if successful, otherwise -1
+ */
+static int32_t
+uitf_config_cache_save(const char *filename, const struct stat *src)
+{
+  char name[PATH_MAX], tmp[PATH_MAX + 8];
+  uitf_config_cache_t *cache;
+  uitf_config_cache_header_t *h;
+  size_t size = sizeof(uitf_config_cache_t) + uitf_nfadc * sizeof(fadc_config_t);
+  FILE *f = NULL;
+  int32_t fd, ok;
+
+  cache = calloc(1, size);
+  if(cache == NULL)
+    return -1;
+
+  h = &cache->header;
+  cache->ti = ti_params;
+  cache->hd = hd_params;
+  cache->readout = readout_params;
+  cache->nfadc = uitf_nfadc;
+  memcpy(cache->fadc, fadc_params, uitf_nfadc * sizeof(fadc_config_t));
+
+  h->magic = UITF_CONFIG_CACHE_MAGIC;
+  h->version = UITF_CONFIG_CACHE_VERSION;
+  h->size = size;
+  h->layout = uitf_config_cache_layout();
+  h->src_mtime_ns = (int64_t)src->st_mtim.tv_sec * 1000000000LL + src->st_mtim.tv_nsec;
+  h->src_size = src->st_size;
+  h->src_hash = uitf_config_hash;
+  h->checksum = uitf_config_fnv1a(UITF_FNV1A_INIT, &cache->ti, size - sizeof(*h));
+
+  /* Write and rename, so a reader never sees a partial image.  The
+     temporary file has a unique name, as ROCs may share the config
+     directory, and is readable by all, as the image is */
+  uitf_config_cache_name(filename, name, sizeof(name));
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", name);
+
+  fd = mkstemp(tmp);
+  if((fd < 0) || (fchmod(fd, 0644) != 0) || ((f = fdopen(fd, "w")) == NULL))
+    {
+      if(fd >= 0)
+	{
+	  close(fd);
+	  unlink(tmp);
+	}
+      printf("%s: WARN: Unable to write %s.  Config not cached\n", __func__, tmp);
+      free(cache);
+      return -1;
+    }
+
+  ok = (fwrite(cache, size, 1, f) == 1);
+  ok &= (fclose(f) == 0);
+  free(cache);
+
+  if(!ok || (rename(tmp, name) != 0))
+    {
+      printf("%s: WARN: Unable to write %s.  Config not cached\n", __func__, name);
+      unlink(tmp);
+      return -1;
+    }
+
+  return 0;
+}
 
 /**
  * @details Initialize the library with the config filename
@@ -34,12 +310,26 @@ fadc_config_t fadc_params[2];
 int32_t
 uitf_config_init(char *filename)
 {
+  struct stat src;
+  int32_t rval;
+
   if(filename==NULL)
     {
       printf("%s: ERROR: filename may not be NULL\n", __func__);
       return -1;
     }
 
+  uitf_config_hash = uitf_config_file_hash(filename);
+
+  /* Use the cached image, if it is from this version of the file */
+  if((stat(filename, &src) == 0) &&
+     (uitf_config_cache_load(filename, &src) == 0))
+    {
+      printf("%s: %s: loaded from %s%s\n", __func__, filename,
+	     filename, UITF_CONFIG_CACHE_SUFFIX);
+      return 0;
+    }
+
   config_init(&uitfCfg);
 
   /* Read the file. If there is an error, report it and exit. */
@@ -54,19 +344,566 @@ uitf_config_init(char *filename)
 
   memset(&ti_params, 0, sizeof(ti_params));
   memset(&hd_params, 0, sizeof(hd_params));
-  memset(&fadc_params, 0, sizeof(fadc_params));
+  memset(&readout_params, 0, sizeof(readout_params));
+  readout_params.sync_check = 1;
+  uitf_config_fadc_init(0);
 
-  return uitf_config_parse();
+  uitf_config_dma_default(&ti_params.dma);
+  uitf_config_dma_default(&hd_params.dma);
+
+  rval = uitf_config_parse();
+  config_destroy(&uitfCfg);
+
+  if(rval != 0)
+    return rval;
+
+  if(uitf_config_validate() != 0)
+    return -1;
+
+  /* Re-stat, in case the file changed while it was parsed */
+  if((stat(filename, &src) == 0) &&
+     (uitf_config_file_hash(filename) == uitf_config_hash))
+    uitf_config_cache_save(filename, &src);
+
+  return 0;
 }
 
-#define FIND_N_FILL(x_config_setting, x_params, x_param_name) {		\
-    config_setting_lookup_int(x_config_setting, #x_param_name,		\
-			      (int32_t *)&x_params.x_param_name);}
+/* Config schema.  Each struct filled from the config file has a table
+   of its settings: key, type, offset in the struct, and allowed range.
+   uitf_config_fill walks a config group with its table, checks types
+   and ranges, and reports keys that are not in the table.  A new
+   setting is a struct member and a line in its table. */
+enum
+  {
+    UITF_CFG_END = 0,
+    UITF_CFG_INT,		/* uint32_t in [min, max] */
+    UITF_CFG_ENUM,		/* string, stored as its index in names */
+    UITF_CFG_INTS,		/* array of exactly count uint32_t, each in [min, max] */
+    UITF_CFG_GROUP,		/* struct, filled from sub */
+    UITF_CFG_LIST		/* min..count structs of size, filled from sub.
+				   The number found is stored at count_offset */
+  };
+
+#define UITF_CFG_REQUIRED 0x1
+
+typedef struct uitf_config_field
+{
+  const char *key;
+  uint32_t type;
+  uint32_t flags;
+  size_t offset;
+  int64_t min;
+  int64_t max;
+  uint32_t count;
+  size_t size;
+  size_t count_offset;
+  const struct uitf_config_field *sub;
+  const char * const *names;
+} uitf_config_field_t;
+
+#define UITF_CFG_U32 0xffffffffLL
+
+#define CFG_INT(s, m, lo, hi)						\
+  { .key = #m, .type = UITF_CFG_INT, .offset = offsetof(s, m),		\
+      .min = lo, .max = hi }
+#define CFG_BOOL(s, m)  CFG_INT(s, m, 0, 1)
+#define CFG_ENUM(s, m, fl, n)						\
+  { .key = #m, .type = UITF_CFG_ENUM, .flags = fl,			\
+      .offset = offsetof(s, m), .names = n }
+#define CFG_INTS(s, m, fl, lo, hi)					\
+  { .key = #m, .type = UITF_CFG_INTS, .flags = fl,			\
+      .offset = offsetof(s, m), .min = lo, .max = hi,			\
+      .count = sizeof(((s *)0)->m) / sizeof(uint32_t) }
+#define CFG_GROUP(k, s, m, fl, t)					\
+  { .key = k, .type = UITF_CFG_GROUP, .flags = fl,			\
+      .offset = offsetof(s, m), .sub = t }
+#define CFG_LIST(k, s, m, n, fl, lo, t)					\
+  { .key = k, .type = UITF_CFG_LIST, .flags = fl,			\
+      .offset = offsetof(s, m), .min = lo,				\
+      .count = sizeof(((s *)0)->m) / sizeof(((s *)0)->m[0]),		\
+      .size = sizeof(((s *)0)->m[0]), .count_offset = offsetof(s, n),	\
+      .sub = t }
+#define CFG_END { .key = NULL }
+
+static const uitf_config_field_t uitf_schema_dma[] =
+  {
+    CFG_INT(dma_config_t, addrmode, 0, 2),
+    CFG_INT(dma_config_t, datamode, 0, 5),
+    CFG_INT(dma_config_t, sstmode, 0, 2),
+    CFG_END
+  };
+
+static const uitf_config_field_t uitf_schema_trigger_rule[] =
+  {
+    CFG_INT(trigger_rule_t, period, 0, 0x7f),
+    CFG_INT(trigger_rule_t, timestep, 0, 2),
+    CFG_END
+  };
+
+static const uitf_config_field_t uitf_schema_random_pulser[] =
+  {
+    CFG_BOOL(random_pulser_t, enabled),
+    CFG_INT(random_pulser_t, prescale, 0, 0xf),
+    CFG_END
+  };
+
+static const uitf_config_field_t uitf_schema_fixed_pulser[] =
+  {
+    CFG_BOOL(fixed_pulser_t, enabled),
+    CFG_INT(fixed_pulser_t, nevents, 0, UITF_CFG_U32),
+    CFG_INT(fixed_pulser_t, period, 0, UITF_CFG_U32),
+    CFG_INT(fixed_pulser_t, timestep, 0, 1),
+    CFG_END
+  };
+
+static const uitf_config_field_t uitf_schema_ti[] =
+  {
+    CFG_INT(ti_config_t, blocklevel, 1, 255),
+    CFG_INT(ti_config_t, bufferlevel, 0, 0xffff),
+    CFG_INT(ti_config_t, prescale, 0, 0xf),
+    CFG_LIST("trigger_rules", ti_config_t, rule, nrule, UITF_CFG_REQUIRED, 1,
+	     uitf_schema_trigger_rule),
+    CFG_GROUP("random_pulser", ti_config_t, random, UITF_CFG_REQUIRED,
+	      uitf_schema_random_pulser),
+    CFG_GROUP("fixed_pulser", ti_config_t, fixed, UITF_CFG_REQUIRED,
+	      uitf_schema_fixed_pulser),
+    CFG_GROUP("dma", ti_config_t, dma, 0, uitf_schema_dma),
+    CFG_END
+  };
+
+static const uitf_config_field_t uitf_schema_internal_helicity[] =
+  {
+    CFG_INT(internal_helicity_t, helicity_pattern, 0, 3),
+    CFG_INT(internal_helicity_t, window_delay, 0, UITF_CFG_U32),
+    CFG_INT(internal_helicity_t, settle_time, 0, 0xffff),
+    CFG_INT(internal_helicity_t, stable_time, 0, UITF_CFG_U32),
+    CFG_INT(internal_helicity_t, seed, 0, UITF_CFG_U32),
+    CFG_END
+  };
+
+static const uitf_config_field_t uitf_schema_hd[] =
+  {
+    CFG_BOOL(hd_config_t, enabled),
+    CFG_INT(hd_config_t, address, 0, 0xffffff),
+    CFG_INT(hd_config_t, slot, 0, 21),
+    CFG_INT(hd_config_t, input_delay, 0, 0xffff),
+    CFG_INT(hd_config_t, trigger_latency_delay, 0, 0xffff),
+    CFG_BOOL(hd_config_t, use_internal_helicity),
+    CFG_INT(hd_config_t, ready_timeout_ns, 0, UITF_CFG_U32),
+    CFG_INT(hd_config_t, words_per_event, 0, 0xffff),
+    CFG_GROUP("internal_helicity", hd_config_t, internal, UITF_CFG_REQUIRED,
+	      uitf_schema_internal_helicity),
+    CFG_GROUP("dma", hd_config_t, dma, 0, uitf_schema_dma),
+    CFG_END
+  };
+
+static const char * const uitf_fadc_type_names[] = { "counting", "integrating", NULL };
+
+static const uitf_config_field_t uitf_schema_fadc[] =
+  {
+    CFG_ENUM(fadc_config_t, type, UITF_CFG_REQUIRED, uitf_fadc_type_names),
+    CFG_INT(fadc_config_t, address, 0, 0xffffff),
+    CFG_INT(fadc_config_t, slot, 0, 21),
+    CFG_INT(fadc_config_t, sd_fp_address, 0, 0xffff),
+    CFG_INT(fadc_config_t, init_arg, 0, UITF_CFG_U32),
+    CFG_INT(fadc_config_t, mode, 1, 10),
+    CFG_INT(fadc_config_t, pl, 0, 0xffff),
+    CFG_INT(fadc_config_t, ptw, 0, 0xffff),
+    CFG_INT(fadc_config_t, nsb, 0, 0xffff),
+    CFG_INT(fadc_config_t, nsa, 0, 0xffff),
+    CFG_INT(fadc_config_t, np, 0, 4),
+    CFG_INT(fadc_config_t, delay8, 0, 0xffff),
+    CFG_INT(fadc_config_t, delay9, 0, 0xffff),
+    CFG_INT(fadc_config_t, delay11, 0, 0xffff),
+    CFG_INT(fadc_config_t, ready_timeout_ns, 0, UITF_CFG_U32),
+    CFG_INT(fadc_config_t, max_words, 0, 0x3fffff),
+    CFG_INTS(fadc_config_t, dac, UITF_CFG_REQUIRED, 0, 0xfff),
+    CFG_INTS(fadc_config_t, threshold, UITF_CFG_REQUIRED, 0, 0xfff),
+    CFG_GROUP("dma", fadc_config_t, dma, 0, uitf_schema_dma),
+    CFG_END
+  };
+
+static const char * const uitf_readout_mode_names[] = { "poll", "interrupt", "auto", NULL };
+static const char * const uitf_asym_pattern_names[] =
+  { "internal", "pair", "quartet", "octet", "toggle", NULL };
+
+static const uitf_config_field_t uitf_schema_readout[] =
+  {
+    CFG_BOOL(readout_config_t, chained_dma),
+    CFG_BOOL(readout_config_t, async_status),
+    CFG_INT(readout_config_t, perf_interval, 0, 3600),
+    CFG_ENUM(readout_config_t, readout_mode, 0, uitf_readout_mode_names),
+    CFG_INT(readout_config_t, poll_above_hz, 0, UITF_CFG_U32),
+    CFG_INT(readout_config_t, interrupt_below_hz, 0, UITF_CFG_U32),
+    CFG_INT(readout_config_t, event_pool, 0, UITF_CFG_U32),
+    CFG_BOOL(readout_config_t, pipeline),
+    CFG_INT(readout_config_t, pipeline_depth, 0, UITF_CFG_U32),
+    CFG_BOOL(readout_config_t, sync_check),
+    CFG_INT(readout_config_t, sync_budget_us, 0, 1000000),
+    CFG_BOOL(readout_config_t, recovery),
+    CFG_INT(readout_config_t, recovery_budget_ms, 0, 1000),
+    CFG_INT(readout_config_t, recovery_max, 0, 1000000),
+    CFG_BOOL(readout_config_t, asym),
+    CFG_INT(readout_config_t, asym_interval, 0, 3600),
+    CFG_ENUM(readout_config_t, asym_pattern, 0, uitf_asym_pattern_names),
+    CFG_BOOL(readout_config_t, pulse),
+    CFG_INT(readout_config_t, pulse_raw_prescale, 0, 1000000),
+    CFG_BOOL(readout_config_t, full_init),
+    CFG_END
+  };
+
+/* Top level keys.  fadc250 is a list of uitf_schema_fadc, filled by
+   uitf_config_parse into fadc_params */
+static const char * const uitf_config_top_keys[] =
+  { "Date_Created", "ti", "helicity_decoder", "fadc250", "readout", NULL };
+
+/**
+ * @details Hash the layout of a schema: the key, type, offset, count and
+ *          size of each setting, and of the settings of its groups
+ * @param[in] hash Hash so far
+ * @param[in] schema Settings of the struct
+ * @return Updated hash
+ */
+static uint64_t
+uitf_config_schema_hash(uint64_t hash, const uitf_config_field_t *schema)
+{
+  const uitf_config_field_t *field;
+
+  for(field = schema; field->key != NULL; field++)
+    {
+      uint64_t layout[] =
+	{
+	  field->type, field->offset, field->count, field->size,
+	  field->count_offset
+	};
+
+      hash = uitf_config_fnv1a(hash, field->key, strlen(field->key));
+      hash = uitf_config_fnv1a(hash, layout, sizeof(layout));
+      if(field->sub != NULL)
+	hash = uitf_config_schema_hash(hash, field->sub);
+    }
+
+  return hash;
+}
+
+/**
+ * @details Layout of the cached image: the struct sizes, the offsets of
+ *          the image members, and the offset of every setting in the schemas
+ * @return Hash of the layout
+ */
+static uint32_t
+uitf_config_cache_layout()
+{
+  uint64_t hash;
+  uint64_t layout[] =
+    {
+      sizeof(ti_config_t), sizeof(hd_config_t), sizeof(fadc_config_t),
+      sizeof(readout_config_t), sizeof(uitf_config_cache_t),
+      offsetof(uitf_config_cache_t, ti), offsetof(uitf_config_cache_t, hd),
+      offsetof(uitf_config_cache_t, readout), offsetof(uitf_config_cache_t, nfadc),
+      offsetof(uitf_config_cache_t, fadc)
+    };
+
+  hash = uitf_config_fnv1a(UITF_FNV1A_INIT, layout, sizeof(layout));
+  hash = uitf_config_schema_hash(hash, uitf_schema_ti);
+  hash = uitf_config_schema_hash(hash, uitf_schema_hd);
+  hash = uitf_config_schema_hash(hash, uitf_schema_fadc);
+  hash = uitf_config_schema_hash(hash, uitf_schema_readout);
+
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+/* Integer setting, in range.  Returns 0 if OK, otherwise -1 */
+static int32_t
+uitf_config_int(const config_setting_t *s, const char *path,
+		int64_t min, int64_t max, uint32_t *value)
+{
+  long long v;
+
+  switch(config_setting_type(s))
+    {
+    case CONFIG_TYPE_INT:
+    case CONFIG_TYPE_INT64:
+      v = config_setting_get_int64(s);
+      break;
+
+    case CONFIG_TYPE_BOOL:
+      v = config_setting_get_bool(s);
+      break;
+
+    default:
+      printf("%s: ERROR: %s (line %d) is not an integer\n",
+	     __func__, path, config_setting_source_line(s));
+      return -1;
+    }
+
+  if((v < min) || (v > max))
+    {
+      printf("%s: ERROR: %s (line %d) = %lld not in %lld..%lld\n",
+	     __func__, path, config_setting_source_line(s), v,
+	     (long long)min, (long long)max);
+      return -1;
+    }
+
+  *value = (uint32_t)v;
+  return 0;
+}
+
+/**
+ * @details Fill a struct from a config group, with its schema
+ * @param[in] group Config group
+ * @param[in] path Name of the group, for the report
+ * @param[in] schema Settings of the struct
+ * @param[out] base Struct to fill.  Settings not in the group are not changed.
+ * @return Number of errors
+ */
+static int32_t
+uitf_config_fill(const config_setting_t *group, const char *path,
+		 const uitf_config_field_t *schema, void *base)
+{
+  const uitf_config_field_t *field;
+  config_setting_t *s;
+  char name[256];
+  int32_t nerror = 0, imember, nmember, ielem, nelem, iname;
+  uint32_t *value;
+
+  /* Keys that are not in the schema */
+  nmember = config_setting_length(group);
+  for(imember = 0; imember < nmember; imember++)
+    {
+      const char *key = config_setting_name(config_setting_get_elem(group, imember));
+
+      for(field = schema; field->key != NULL; field++)
+	if((key != NULL) && (strcmp(key, field->key) == 0))
+	  break;
+
+      if(field->key == NULL)
+	printf("%s: WARN: unknown key %s.%s (line %d).  Ignored\n", __func__, path,
+	       key ? key : "?",
+	       config_setting_source_line(config_setting_get_elem(group, imember)));
+    }
+
+  for(field = schema; field->key != NULL; field++)
+    {
+      snprintf(name, sizeof(name), "%s.%s", path, field->key);
+      value = (uint32_t *)((char *)base + field->offset);
+
+      s = config_setting_get_member(group, field->key);
+      if(s == NULL)
+	{
+	  if(field->flags & UITF_CFG_REQUIRED)
+	    {
+	      printf("%s: ERROR: %s missing\n", __func__, name);
+	      nerror++;
+	    }
+	  continue;
+	}
+
+      switch(field->type)
+	{
+	case UITF_CFG_INT:
+	  if(uitf_config_int(s, name, field->min, field->max, value) != 0)
+	    nerror++;
+	  break;
+
+	case UITF_CFG_ENUM:
+	  {
+	    const char *str = config_setting_get_string(s);
+
+	    if(str == NULL)
+	      {
+		printf("%s: ERROR: %s (line %d) is not a string\n",
+		       __func__, name, config_setting_source_line(s));
+		nerror++;
+		break;
+	      }
+
+	    for(iname = 0; field->names[iname] != NULL; iname++)
+	      if(strcasecmp(str, field->names[iname]) == 0)
+		break;
+
+	    if(field->names[iname] == NULL)
+	      {
+		printf("%s: ERROR: %s (line %d): unknown value \"%s\"\n",
+		       __func__, name, config_setting_source_line(s), str);
+		nerror++;
+	      }
+	    else
+	      *value = iname;
+	  }
+	  break;
+
+	case UITF_CFG_INTS:
+	  nelem = config_setting_length(s);
+	  if(!(config_setting_is_array(s) || config_setting_is_list(s)) ||
+	     (nelem != (int32_t)field->count))
+	    {
+	      printf("%s: ERROR: %s (line %d) needs %d values\n",
+		     __func__, name, config_setting_source_line(s), field->count);
+	      nerror++;
+	      break;
+	    }
+
+	  for(ielem = 0; ielem < nelem; ielem++)
+	    {
+	      char elem[sizeof(name) + 16];
+	      snprintf(elem, sizeof(elem), "%s[%d]", name, ielem);
+	      if(uitf_config_int(config_setting_get_elem(s, ielem), elem,
+				 field->min, field->max, &value[ielem]) != 0)
+		nerror++;
+	    }
+	  break;
+
+	case UITF_CFG_GROUP:
+	  if(!config_setting_is_group(s))
+	    {
+	      printf("%s: ERROR: %s (line %d) is not a group\n",
+		     __func__, name, config_setting_source_line(s));
+	      nerror++;
+	      break;
+	    }
+	  nerror += uitf_config_fill(s, name, field->sub, value);
+	  break;
+
+	case UITF_CFG_LIST:
+	  nelem = config_setting_length(s);
+	  if(!config_setting_is_list(s) ||
+	     (nelem < field->min) || (nelem > (int32_t)field->count))
+	    {
+	      printf("%s: ERROR: %s (line %d) needs a list of %d..%d groups\n",
+		     __func__, name, config_setting_source_line(s),
+		     (int32_t)field->min, field->count);
+	      nerror++;
+	      break;
+	    }
+
+	  for(ielem = 0; ielem < nelem; ielem++)
+	    {
+	      char elem[sizeof(name) + 16];
+	      config_setting_t *e = config_setting_get_elem(s, ielem);
+
+	      snprintf(elem, sizeof(elem), "%s[%d]", name, ielem);
+	      if(!config_setting_is_group(e))
+		{
+		  printf("%s: ERROR: %s is not a group\n", __func__, elem);
+		  nerror++;
+		  continue;
+		}
+	      nerror += uitf_config_fill(e, elem, field->sub,
+					 (char *)value + ielem * field->size);
+	    }
+	  *(uint32_t *)((char *)base + field->count_offset) = nelem;
+	  break;
+	}
+    }
+
+  return nerror;
+}
 
 #define PRINT_PARAM(x_params, x_params_name) {				\
     printf("%s: %s.%s   0x%08x\n", __func__, #x_params, #x_params_name,	\
 	   x_params.x_params_name);}
 
+/**
+ * @details Group channels by value, for one masked write per value
+ * @param[in] want Value for each channel
+ * @param[in] have Readback for each channel.  Matching channels are skipped.
+ * @param[out] value Value of each group
+ * @param[out] mask Channel mask of each group
+ * @return Number of groups
+ */
+static int32_t
+uitf_config_fadc_group(const uint32_t *want, const uint32_t *have,
+		       uint32_t *value, uint16_t *mask)
+{
+  int32_t ich, igroup, ngroup = 0;
+
+  for(ich = 0; ich < UITF_FADC_NCHAN; ich++)
+    {
+      if(want[ich] == have[ich])
+	continue;
+
+      for(igroup = 0; igroup < ngroup; igroup++)
+	if(value[igroup] == want[ich])
+	  break;
+
+      if(igroup == ngroup)
+	{
+	  value[ngroup] = want[ich];
+	  mask[ngroup] = 0;
+	  ngroup++;
+	}
+      mask[igroup] |= (1 << ich);
+    }
+
+  return ngroup;
+}
+
+/**
+ * @details Program the DAC and threshold of each fadc250 channel.
+ *          Channels that read back the wanted value are skipped, and the
+ *          rest are written with one masked call per distinct value.
+ * @param[in] ifa fadc250 index, in config file order
+ * @return OK if the readback matches after writing, otherwise ERROR
+ */
+static int32_t
+uitf_config_fadc_dac_threshold(int32_t ifa)
+{
+  int32_t slot = fadc_params[ifa].slot, ich, igroup, ngroup, nwrite = 0;
+  int32_t rval = OK;
+  uint32_t have[UITF_FADC_NCHAN], value[UITF_FADC_NCHAN];
+  uint16_t mask[UITF_FADC_NCHAN], written = 0;
+
+  /* Input DAC */
+  for(ich = 0; ich < UITF_FADC_NCHAN; ich++)
+    have[ich] = faGetChannelDAC(slot, ich);
+
+  ngroup = uitf_config_fadc_group(fadc_params[ifa].dac, have, value, mask);
+  for(igroup = 0; igroup < ngroup; igroup++)
+    {
+      faSetDAC(slot, value[igroup], mask[igroup]);
+      written |= mask[igroup];
+    }
+  nwrite += ngroup;
+
+  for(ich = 0; ich < UITF_FADC_NCHAN; ich++)
+    if((written & (1 << ich)) &&
+       (faGetChannelDAC(slot, ich) != fadc_params[ifa].dac[ich]))
+      {
+	printf("%s: ERROR: slot %d ch %d: DAC readback 0x%x != 0x%x\n",
+	       __func__, slot, ich, faGetChannelDAC(slot, ich),
+	       fadc_params[ifa].dac[ich]);
+	rval = ERROR;
+      }
+
+  /* Threshold, programmed with the DAC values as before */
+  written = 0;
+  for(ich = 0; ich < UITF_FADC_NCHAN; ich++)
+    have[ich] = faGetChThreshold(slot, ich);
+
+  ngroup = uitf_config_fadc_group(fadc_params[ifa].dac, have, value, mask);
+  for(igroup = 0; igroup < ngroup; igroup++)
+    {
+      faSetThreshold(slot, value[igroup], mask[igroup]);
+      written |= mask[igroup];
+    }
+  nwrite += ngroup;
+
+  for(ich = 0; ich < UITF_FADC_NCHAN; ich++)
+    if((written & (1 << ich)) &&
+       ((uint32_t)faGetChThreshold(slot, ich) != fadc_params[ifa].dac[ich]))
+      {
+	printf("%s: ERROR: slot %d ch %d: threshold readback 0x%x != 0x%x\n",
+	       __func__, slot, ich, faGetChThreshold(slot, ich),
+	       fadc_params[ifa].dac[ich]);
+	rval = ERROR;
+      }
+
+  printf("%s: slot %d: %d masked DAC/threshold writes\n", __func__, slot, nwrite);
+
+  return rval;
+}
+
 /**
  * @details Parse the configfile opened with uitf_config_init
  * @return 0 if successful, otherwise -1
@@ -74,206 +911,447 @@ uitf_config_init(char *filename)
 int32_t
 uitf_config_parse()
 {
+  config_setting_t *root, *conf;
+  int32_t nerror = 0, imember, ikey, ifa, nfa;
+  char name[32];
 
-  config_setting_t *confti, *confhd, *confadc;
-  int32_t len;
+  root = config_root_setting(&uitfCfg);
+  for(imember = 0; imember < config_setting_length(root); imember++)
+    {
+      config_setting_t *s = config_setting_get_elem(root, imember);
+      const char *key = config_setting_name(s);
+
+      for(ikey = 0; uitf_config_top_keys[ikey] != NULL; ikey++)
+	if((key != NULL) && (strcmp(key, uitf_config_top_keys[ikey]) == 0))
+	  break;
+
+      if(uitf_config_top_keys[ikey] == NULL)
+	printf("%s: WARN: unknown key %s (line %d).  Ignored\n", __func__,
+	       key ? key : "?", config_setting_source_line(s));
+    }
 
   //
   // TI
   //
-  confti = config_lookup(&uitfCfg, "ti");
-  if(config_setting_length(confti) < 0)
+  conf = config_lookup(&uitfCfg, "ti");
+  if(conf == NULL)
     {
-      printf("%s: ERROR: TI missing from config\n",
-	   __func__);
+      printf("%s: ERROR: TI missing from config\n", __func__);
       return -1;
     }
+  nerror += uitf_config_fill(conf, "ti", uitf_schema_ti, &ti_params);
 
-  FIND_N_FILL(confti, ti_params, blocklevel);
-  FIND_N_FILL(confti, ti_params, bufferlevel);
-  FIND_N_FILL(confti, ti_params, prescale);
-
-  // ti: check for trigger rules
-  config_setting_t *trig_rules = config_setting_get_member(confti, "trigger_rules");
-  if(trig_rules==NULL)
+  //
+  // Helcity Decoder
+  //
+  conf = config_lookup(&uitfCfg, "helicity_decoder");
+  if(conf == NULL)
     {
-      printf("%s: didn't find trigger_rules\n", __func__);
+      printf("%s: ERROR: helicity decoder missing from config\n", __func__);
       return -1;
     }
+  nerror += uitf_config_fill(conf, "helicity_decoder", uitf_schema_hd, &hd_params);
 
-  int32_t itr = 0, ntr = 0;
-  ntr = config_setting_length(trig_rules);
-  if(ntr != 4)
+  //
+  // fadc250: a list of any number of boards
+  //
+  conf = config_lookup(&uitfCfg, "fadc250");
+  nfa = conf ? config_setting_length(conf) : 0;
+  if((conf == NULL) || !config_setting_is_list(conf) ||
+     (nfa < 1) || (nfa > UITF_FADC_MAX))
     {
-      printf("%s: not the right number of ntr (%d)\n", __func__, ntr);
+      printf("%s: ERROR: fadc250 needs a list of 1..%d boards.  Found: %d\n",
+	     __func__, UITF_FADC_MAX, nfa);
       return -1;
     }
-  for(itr = 0; itr < ntr; itr++)
-    {
-      // get each trigger rule and extract period and timestep
-      const config_setting_t *tr = config_setting_get_elem(trig_rules, itr);
 
-      FIND_N_FILL(tr, ti_params.rule[itr], period);
-      FIND_N_FILL(tr, ti_params.rule[itr], timestep);
-    }
+  if(uitf_config_fadc_init(nfa) != 0)
+    return -1;
 
+  for(ifa = 0; ifa < nfa; ifa++)
+    {
+      snprintf(name, sizeof(name), "fadc250[%d]", ifa);
+      nerror += uitf_config_fill(config_setting_get_elem(conf, ifa), name,
+				 uitf_schema_fadc, &fadc_params[ifa]);
+    }
 
+  //
+  // readout (optional)
+  //
+  conf = config_lookup(&uitfCfg, "readout");
+  if(conf != NULL)
+    nerror += uitf_config_fill(conf, "readout", uitf_schema_readout, &readout_params);
 
-  // ti: check for random pulser
-  config_setting_t *rand_pulser = config_setting_get_member(confti, "random_pulser");
-  if(rand_pulser==NULL)
+  if(nerror)
     {
-      printf("%s: didn't find random_pulser\n", __func__);
+      printf("%s: ERROR: %d error%s in config\n", __func__, nerror,
+	     (nerror == 1) ? "" : "s");
       return -1;
     }
-  FIND_N_FILL(rand_pulser, ti_params.random, enabled);
-  FIND_N_FILL(rand_pulser, ti_params.random, prescale);
 
-  // ti: check for fixed pulser
-  config_setting_t *fixed_pulser = config_setting_get_member(confti, "fixed_pulser");
-  if(fixed_pulser==NULL)
+  if(readout_params.poll_above_hz == 0)
+    readout_params.poll_above_hz = UITF_POLL_ABOVE_HZ;
+  if(readout_params.interrupt_below_hz == 0)
+    readout_params.interrupt_below_hz = UITF_INTERRUPT_BELOW_HZ;
+  if(readout_params.sync_budget_us == 0)
+    readout_params.sync_budget_us = UITF_SYNC_BUDGET_US;
+  if(readout_params.recovery_budget_ms == 0)
+    readout_params.recovery_budget_ms = UITF_RECOVERY_BUDGET_MS;
+  if(readout_params.recovery_max == 0)
+    readout_params.recovery_max = UITF_RECOVERY_MAX;
+  if(readout_params.asym_interval == 0)
+    readout_params.asym_interval = UITF_ASYM_INTERVAL;
+  if(readout_params.interrupt_below_hz > readout_params.poll_above_hz)
     {
-      printf("%s: didn't find fixed_pulser\n", __func__);
+      printf("%s: ERROR: interrupt_below_hz (%d) > poll_above_hz (%d)\n",
+	     __func__, readout_params.interrupt_below_hz,
+	     readout_params.poll_above_hz);
       return -1;
     }
-  FIND_N_FILL(fixed_pulser, ti_params.fixed, enabled);
-  FIND_N_FILL(fixed_pulser, ti_params.fixed, nevents);
-  FIND_N_FILL(fixed_pulser, ti_params.fixed, period);
-  FIND_N_FILL(fixed_pulser, ti_params.fixed, timestep);
 
+  return 0;
+}
 
-  //
-  // Helcity Decoder
-  //
-  confhd = config_lookup(&uitfCfg, "helicity_decoder");
-  if(config_setting_length(confhd) < 0)
+/**
+ * @details Check the parsed parameters, and print a report of what is
+ *          out of range (ERROR) or suspicious (WARN)
+ * @return 0 if there are no errors, otherwise -1
+ */
+int32_t
+uitf_config_validate()
+{
+  int32_t ifa, jfa, nerror = 0, nwarn = 0;
+
+#define VALIDATE_ERROR(...) { printf("%s: ERROR: ", __func__); printf(__VA_ARGS__); nerror++; }
+#define VALIDATE_WARN(...)  { printf("%s: WARN: ", __func__); printf(__VA_ARGS__); nwarn++; }
+
+  if(ti_params.bufferlevel == 0)
+    VALIDATE_WARN("ti.bufferlevel is 0\n");
+
+  if(hd_params.enabled)
     {
-      printf("%s: ERROR: helicity decoder missing from config\n",
-	   __func__);
-      return -1;
+      if(hd_params.slot < 2)
+	VALIDATE_ERROR("helicity_decoder.slot (%d) not in 2..21\n", hd_params.slot);
+      if(hd_params.words_per_event == 0)
+	VALIDATE_WARN("helicity_decoder.words_per_event not set.  DMA sized for the maximum\n");
     }
-  FIND_N_FILL(confhd, hd_params, enabled);
-  FIND_N_FILL(confhd, hd_params, address);
-  FIND_N_FILL(confhd, hd_params, slot);
 
-  FIND_N_FILL(confhd, hd_params, input_delay);
-  FIND_N_FILL(confhd, hd_params, trigger_latency_delay);
+  for(ifa = 0; ifa < uitf_nfadc; ifa++)
+    {
+      fadc_config_t *fa = &fadc_params[ifa];
+
+      if(fa->slot < 2)
+	VALIDATE_ERROR("fadc250[%d]: slot (%d) not in 2..21\n", ifa, fa->slot);
+      if(hd_params.enabled && (fa->slot == hd_params.slot))
+	VALIDATE_ERROR("fadc250[%d]: slot (%d) is the helicity_decoder slot\n",
+		       ifa, fa->slot);
+      for(jfa = 0; jfa < ifa; jfa++)
+	if(fa->slot == fadc_params[jfa].slot)
+	  VALIDATE_ERROR("fadc250[%d] and fadc250[%d] in the same slot (%d)\n",
+			 jfa, ifa, fa->slot);
+
+      if(uitf_config_fadc_block_words(fa, 1, NULL) < 0)
+	VALIDATE_ERROR("fadc250[%d]: unknown mode (%d)\n", ifa, fa->mode);
+      /* No samples: the firmware writes its own format (e.g. the Mott
+	 integrating sums), which the mode does not size */
+      if((fa->mode == 1) && (fa->ptw == 0) && (fa->max_words == 0))
+	VALIDATE_ERROR("fadc250[%d]: mode 1 with ptw 0 needs max_words\n", ifa);
+    }
+
+#undef VALIDATE_ERROR
+#undef VALIDATE_WARN
+
+  printf("%s: %d fadc250, %d error%s, %d warning%s\n", __func__, uitf_nfadc,
+	 nerror, (nerror == 1) ? "" : "s", nwarn, (nwarn == 1) ? "" : "s");
+
+  return (nerror == 0) ? 0 : -1;
+}
+
+/**
+ * @details Largest fadc250 block the processing mode can produce, or
+ *          max_words if it is set
+ * @param[in] fa fadc250 parameters (mode, ptw, nsb, nsa, np, max_words)
+ * @param[in] blocklevel Events per block
+ * @param[out] fixed 1 if every block has exactly this size (raw window
+ *             mode), 0 if it depends on the data.  May be NULL.
+ * @return Number of words, including block header/trailer and filler,
+ *         or -1 for an unknown processing mode.
+ */
+int32_t
+uitf_config_fadc_block_words(fadc_config_t *fa, uint32_t blocklevel,
+			     int32_t *fixed)
+{
+  int32_t nwords = 0, nraw = 0, npulse = 0;
+
+  /* window raw data: header + 2 samples per word */
+  nraw = 1 + ((fa->ptw + 1) >> 1);
+  /* pulse raw data: header + 2 samples per word, for NSB + NSA samples */
+  npulse = 1 + ((fa->nsb + fa->nsa + 1) >> 1);
+
+  if(fixed)
+    *fixed = 0;
 
-  FIND_N_FILL(confhd, hd_params, use_internal_helicity);
+  /* Firmware with its own data format (e.g. the Mott integrating sums) */
+  if(fa->max_words)
+    return fa->max_words;
 
-  // hd: check for internal_helicity
-  config_setting_t *int_helicity = config_setting_get_member(confhd, "internal_helicity");
-  if(int_helicity==NULL)
+  switch(fa->mode)
     {
-      printf("%s: didn't find internal_helicity\n", __func__);
+    case 1:			/* raw window */
+      nwords = nraw;
+      if(fixed)
+	*fixed = 1;
+      break;
+
+    case 2:			/* pulse raw */
+      nwords = fa->np * npulse;
+      break;
+
+    case 3:			/* pulse integral */
+    case 4:			/* high resolution time */
+      nwords = fa->np;
+      break;
+
+    case 7:			/* pulse integral + high resolution time */
+      nwords = fa->np * 2;
+      break;
+
+    case 8:			/* raw window + high resolution time */
+      nwords = nraw + fa->np;
+      break;
+
+    case 9:			/* pulse parameter: pedestal + (integral, time) per pulse */
+      nwords = 1 + fa->np * 2;
+      break;
+
+    case 10:			/* raw window + pulse parameter */
+      nwords = nraw + 1 + fa->np * 2;
+      break;
+
+    default:
+      printf("%s: ERROR: Unknown fadc250 processing mode %d\n",
+	     __func__, fa->mode);
       return -1;
     }
-  FIND_N_FILL(int_helicity, hd_params.internal, helicity_pattern);
-  FIND_N_FILL(int_helicity, hd_params.internal, window_delay);
-  FIND_N_FILL(int_helicity, hd_params.internal, settle_time);
-  FIND_N_FILL(int_helicity, hd_params.internal, stable_time);
-  FIND_N_FILL(int_helicity, hd_params.internal, seed);
 
-  //
-  // fadc250
-  //
+  /* event header, 2 trigger time words, and the channels */
+  nwords = 3 + UITF_FADC_NCHAN * nwords;
+  /* block header and trailer */
+  nwords = 2 + blocklevel * nwords;
+
+  /* filler to a 64bit boundary */
+  if(nwords & 0x1)
+    nwords++;
 
-  int32_t ifa, nfa, itype = 0;
-  confadc = config_lookup(&uitfCfg, "fadc250");
-  nfa = config_setting_length(confadc);
-  if(nfa != 2)
+  return nwords;
+}
+
+/**
+ * @details Words in one helicity decoder block
+ * @param[in] blocklevel Events per block
+ * @return Number of words, including block header/trailer and filler,
+ *         or -1 if words_per_event is not configured.
+ */
+int32_t
+uitf_config_hd_block_words(uint32_t blocklevel)
+{
+  int32_t nwords = 0;
+
+  if(hd_params.words_per_event == 0)
+    return -1;
+
+  nwords = 2 + blocklevel * hd_params.words_per_event;
+  if(nwords & 0x1)
+    nwords++;
+
+  return nwords;
+}
+
+/* Last applied module parameters, for uitf_config_modules_init to
+   reprogram only what changed.  Cleared by uitf_config_modules_invalidate */
+static int32_t uitf_applied = 0;
+static uint64_t uitf_applied_hash = 0;
+static uint32_t uitf_applied_blocklevel = 0;
+static hd_config_t hd_applied;
+static fadc_config_t fadc_applied[UITF_FADC_MAX];
+static int32_t uitf_applied_nfadc = 0;
+
+/**
+ * @details Forget the applied module parameters, so the next
+ *          uitf_config_modules_init does a full init
+ */
+void
+uitf_config_modules_invalidate()
+{
+  uitf_applied = 0;
+}
+
+/* Program one fadc250.  full: everything, after faInit.  Otherwise only
+   the settings that differ from the last applied */
+static int32_t
+uitf_config_fadc_program(int32_t ifa, int32_t full)
+{
+  fadc_config_t *fa = &fadc_params[ifa], *was = &fadc_applied[ifa];
+  int32_t blocklevel_changed = (ti_params.blocklevel != uitf_applied_blocklevel);
+
+  if(full)
     {
-      printf("%s: ERROR: fadc250 missing from config.  Found: %d\n",
-	     __func__, nfa);
-      return -1;
+      /* Set clock source to FP (from faSDC) */
+      faSetClockSource(fa->slot, FA_REF_CLK_FP);
+
+      faSoftReset(fa->slot, 0);
+      faEnableBusError(fa->slot);
+      faEnableTriggerOut(fa->slot, 0);
     }
 
-  for(ifa = 0; ifa < nfa; ifa++)
+  faResetTriggerCount(fa->slot);
+
+  if(full || blocklevel_changed)
+    faSetBlockLevel(fa->slot, ti_params.blocklevel);
+
+  /* Set input DAC level and threshold */
+  if(full ||
+     (memcmp(fa->dac, was->dac, sizeof(fa->dac)) != 0) ||
+     (memcmp(fa->threshold, was->threshold, sizeof(fa->threshold)) != 0))
     {
-      const config_setting_t *fa = config_setting_get_elem(confadc, ifa);
+      if(uitf_config_fadc_dac_threshold(ifa) != OK)
+	return ERROR;
+    }
 
-      const char *fadc_type;
-      config_setting_lookup_string(fa, "type", &fadc_type);
+  if(full ||
+     (fa->mode != was->mode) || (fa->pl != was->pl) || (fa->ptw != was->ptw) ||
+     (fa->nsb != was->nsb) || (fa->nsa != was->nsa) || (fa->np != was->np))
+    faSetProcMode(fa->slot, fa->mode, fa->pl, fa->ptw, fa->nsb, fa->nsa, fa->np, 0);
 
-      if(strcasecmp(fadc_type, "counting") == 0)
-	itype = UITF_COUNTING;
-      else if(strcasecmp(fadc_type, "integrating") == 0)
-	itype = UITF_INTEGRATING;
-      else
-	{
-	  printf("%s: ERROR: unknown fadc250 type (%s)\n",
-		 __func__, fadc_type);
-	  return -1;
-	}
+  if(fa->type == UITF_INTEGRATING)
+    {
+      if(full || (fa->delay8 != was->delay8))
+	faSetMottDelay(fa->slot, 8, fa->delay8);
+      if(full || (fa->delay9 != was->delay9))
+	faSetMottDelay(fa->slot, 9, fa->delay9);
+      if(full || (fa->delay11 != was->delay11))
+	faSetMottDelay(fa->slot, 11, fa->delay11);
+    }
+
+  if(full)
+    {
+      /* Enable hitbits for scalers and CTP */
+      faSetHitbitsMode(fa->slot, 1);
+    }
+
+  return OK;
+}
 
-      FIND_N_FILL(fa, fadc_params[itype], address);
-      FIND_N_FILL(fa, fadc_params[itype], slot);
-      FIND_N_FILL(fa, fadc_params[itype], sd_fp_address);
+/* Program the helicity decoder.  full: hdInit and everything.  Otherwise
+   only the settings that differ from the last applied */
+static int32_t
+uitf_config_hd_program(int32_t full)
+{
+  hd_config_t *was = &hd_applied;
+  int32_t stat = OK;
 
-      FIND_N_FILL(fa, fadc_params[itype], init_arg);
+  if(full)
+    {
+      hdSetA32(0x09800000);
+      stat = hdInit(hd_params.address, HD_INIT_FP, HD_INIT_EXTERNAL_FIBER, 0);
+    }
 
-      FIND_N_FILL(fa, fadc_params[itype], mode);
-      FIND_N_FILL(fa, fadc_params[itype], pl);
-      FIND_N_FILL(fa, fadc_params[itype], ptw);
-      FIND_N_FILL(fa, fadc_params[itype], nsb);
-      FIND_N_FILL(fa, fadc_params[itype], nsa);
-      FIND_N_FILL(fa, fadc_params[itype], np);
+  if(full ||
+     (hd_params.input_delay != was->input_delay) ||
+     (hd_params.trigger_latency_delay != was->trigger_latency_delay))
+    hdSetProcDelay(hd_params.input_delay, hd_params.trigger_latency_delay);
 
-      FIND_N_FILL(fa, fadc_params[itype], delay8);
-      FIND_N_FILL(fa, fadc_params[itype], delay9);
-      FIND_N_FILL(fa, fadc_params[itype], delay11);
-      FIND_N_FILL(fa, fadc_params[itype], dac[0]);
+  if(full || (ti_params.blocklevel != uitf_applied_blocklevel))
+    hdSetBlocklevel(ti_params.blocklevel);
 
-      // fadc250: check for dac
-      config_setting_t *dac = config_setting_get_member(fa, "dac");
-      if(dac==NULL)
-	{
-	  printf("%s: didn't find dac\n", __func__);
-	  return -1;
-	}
+  if(full)
+    {
+      /* Enable the module decoder, well before triggers are enabled */
+      hdEnableDecoder();
+    }
 
-      int32_t idac = 0, ndac = 0;
-      ndac = config_setting_length(dac);
-      if(ndac != 16)
-	{
-	  printf("%s: not the right number of dac (%d)\n", __func__, ndac);
-	  return -1;
-	}
+  if(hd_params.use_internal_helicity &&
+     (full || !was->use_internal_helicity ||
+      (memcmp(&hd_params.internal, &was->internal, sizeof(internal_helicity_t)) != 0)))
+    {
+      hdSetHelicitySource(1, 0, 1);
+      hdHelicityGeneratorConfig(hd_params.internal.helicity_pattern,
+				hd_params.internal.window_delay,
+				hd_params.internal.settle_time,
+				hd_params.internal.stable_time,
+				hd_params.internal.seed);
+      hdEnableHelicityGenerator();
+    }
 
-      for(idac = 0; idac < ndac; idac ++)
-	fadc_params[itype].dac[idac] = config_setting_get_int_elem(dac, idac);
+  return stat;
+}
 
-      // fadc250: check for threshold
-      config_setting_t *threshold = config_setting_get_member(fa, "threshold");
-      if(threshold==NULL)
-	{
-	  printf("%s: fadc250: %s: didn't find threshold\n", __func__,
-		 fadc_type);
-	  return -1;
-	}
+/* Module init tasks, run on worker threads by uitf_config_modules_init */
+typedef struct
+{
+  char name[32];
+  int32_t (*func)(int32_t arg);
+  int32_t arg;
+  pthread_t thread;
+  int32_t threaded;
+  int32_t rval;
+  uint64_t ns;
+} uitf_init_task_t;
+
+static int32_t uitf_init_full = 1;
+
+static uint64_t
+uitf_config_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-      int32_t itet = 0, ntet = 0;
-      ntet = config_setting_length(threshold);
-      if(ntet != 16)
-	{
-	  printf("%s: not the right number of threshold (%d)\n", __func__, ntet);
-	  return -1;
-	}
+static void *
+uitf_init_task_run(void *arg)
+{
+  uitf_init_task_t *task = (uitf_init_task_t *)arg;
+  uint64_t start = uitf_config_now();
 
-      for(itet = 0; itet < ntet; itet ++)
-	fadc_params[itype].threshold[itet] = config_setting_get_int_elem(threshold, itet);
+  task->rval = (*task->func)(task->arg);
+  task->ns = uitf_config_now() - start;
 
-    }
+  return NULL;
+}
 
-  return 0;
+/* Start a task on its own thread, or run it here if that fails */
+static void
+uitf_init_task_start(uitf_init_task_t *task)
+{
+  task->threaded = (pthread_create(&task->thread, NULL, uitf_init_task_run, task) == 0);
+  if(!task->threaded)
+    uitf_init_task_run(task);
 }
 
-// use the config file parameters to init libraries and configure modules
-int32_t
-uitf_config_modules_init()
+static void
+uitf_init_task_join(uitf_init_task_t *task)
 {
-  int32_t stat = OK;
+  if(task->threaded)
+    pthread_join(task->thread, NULL);
+  task->threaded = 0;
+}
+
+static int32_t
+uitf_config_fadc_task(int32_t ifa)
+{
+  return uitf_config_fadc_program(ifa, uitf_init_full);
+}
+
+static int32_t
+uitf_config_hd_task(int32_t arg)
+{
+  return uitf_config_hd_program(uitf_init_full);
+}
 
+static int32_t
+uitf_config_ti_program()
+{
   tiEnableTSInput( TI_TSINPUT_ALL );
 
   /* Load the trigger table (3) that associates all TS with physics trigger */
@@ -282,8 +1360,8 @@ uitf_config_modules_init()
   /* Set prompt output width (10 + 2) * 4 = 48 ns */
   tiSetPromptTriggerWidth(0x7f);
 
-  int32_t irule = 0, nrule = 4;
-  for(irule = 0; irule < nrule; irule++)
+  int32_t irule = 0;
+  for(irule = 0; irule < (int32_t)ti_params.nrule; irule++)
     tiSetTriggerHoldoff(irule+1, ti_params.rule[irule].period,
 			ti_params.rule[irule].timestep);
 
@@ -293,94 +1371,146 @@ uitf_config_modules_init()
   /* Set Trigger Buffer Level */
   tiSetBlockBufferLevel(ti_params.bufferlevel);
 
+  return OK;
+}
 
-  extern u_long fadcA32Base;
-  extern uint32_t fadcAddrList[FA_MAX_BOARDS];
-
-  int32_t iflag = fadc_params[UITF_COUNTING].sd_fp_address;
-  iflag |= fadc_params[UITF_COUNTING].init_arg;
-  iflag |= FA_INIT_USE_ADDRLIST;
-
-
-  fadcAddrList[UITF_COUNTING] = fadc_params[UITF_COUNTING].address;
-  fadcAddrList[UITF_INTEGRATING] = fadc_params[UITF_INTEGRATING].address;
+// use the config file parameters to init libraries and configure modules
+//   The helicity decoder and each fadc250 are programmed in parallel, on
+//   their own threads (after faInit, for the fadc250s).  The TI is
+//   programmed last, once the modules are done.
+int32_t
+uitf_config_modules_init()
+{
+  int32_t stat = OK, full = 1, ifa, itask, ntask = 0;
+  uitf_init_task_t task[1 + UITF_FADC_MAX];
+  uint64_t start = uitf_config_now(), ns;
+  extern int32_t nfadc;
 
-  vmeSetQuietFlag(1);
-  fadcA32Base = 0x08800000;
-  stat = faInit(fadcAddrList[0], 0, 2, iflag);
-  faDisableMultiBlock();
-  vmeSetQuietFlag(0);
+  memset(task, 0, sizeof(task));
 
-  faSDC_Init_Integrating(fadc_params[UITF_INTEGRATING].sd_fp_address);
+  /* Full init, unless the fadc250s are already initialized with the
+     same addresses and types, and the helicity decoder the same way */
+  if(uitf_applied && !readout_params.full_init &&
+     (uitf_nfadc == uitf_applied_nfadc) && (nfadc == uitf_nfadc))
+    {
+      full = 0;
+      for(ifa = 0; ifa < uitf_nfadc; ifa++)
+	{
+	  if((fadc_params[ifa].address != fadc_applied[ifa].address) ||
+	     (fadc_params[ifa].slot != fadc_applied[ifa].slot) ||
+	     (fadc_params[ifa].sd_fp_address != fadc_applied[ifa].sd_fp_address) ||
+	     (fadc_params[ifa].init_arg != fadc_applied[ifa].init_arg) ||
+	     (fadc_params[ifa].type != fadc_applied[ifa].type))
+	    full = 1;
+	}
+      if((hd_params.enabled != hd_applied.enabled) ||
+	 (hd_params.address != hd_applied.address) ||
+	 (hd_params.use_internal_helicity != hd_applied.use_internal_helicity))
+	full = 1;
+    }
 
-  extern int32_t nfadc;
-  int ifa;
-  /* Program/Init VME Modules Here */
-  for(ifa = 0; ifa < nfadc; ifa++)
+  if(!full && (uitf_config_hash == uitf_applied_hash) &&
+     (ti_params.blocklevel == uitf_applied_blocklevel))
     {
-      /* Set clock source to FP (from faSDC) */
-      faSetClockSource(fadc_params[ifa].slot, FA_REF_CLK_FP);
+      printf("%s: Config unchanged (hash 0x%016llx).  Modules not reprogrammed\n",
+	     __func__, (unsigned long long)uitf_config_hash);
+      for(ifa = 0; ifa < uitf_nfadc; ifa++)
+	faResetTriggerCount(fadc_params[ifa].slot);
 
-      faSoftReset(fadc_params[ifa].slot, 0);
-      faResetTriggerCount(fadc_params[ifa].slot);
+      /* The TI is initialized by tiprimary_list.c at every Download */
+      return uitf_config_ti_program();
+    }
 
-      faEnableBusError(fadc_params[ifa].slot);
+  uitf_applied = 0;
+  uitf_init_full = full;
 
-      faEnableTriggerOut(fadc_params[ifa].slot, 0);
+  printf("%s: %s module init\n", __func__, full ? "Full" : "Incremental");
 
-      faSetBlockLevel(fadc_params[ifa].slot, ti_params.blocklevel);
+  if(full)
+    {
+      extern u_long fadcA32Base;
+      extern uint32_t fadcAddrList[FA_MAX_BOARDS];
+      int32_t icount = 0, iint = -1;
 
-      /* Set input DAC level */
-      int32_t ich = 0; int32_t nchan = 16;
-      for(ich = 0; ich < nchan; ich++)
+      /* SD/init flags from the first counting board (else the first
+	 board).  The integrating SDC from the first integrating board */
+      for(ifa = uitf_nfadc - 1; ifa >= 0; ifa--)
 	{
-	  faSetDAC(fadc_params[ifa].slot, fadc_params[ifa].dac[ich], (1 << ich));
-	  faSetThreshold(fadc_params[ifa].slot, fadc_params[ifa].dac[ich], (1 << ich));
+	  if(fadc_params[ifa].type == UITF_COUNTING)
+	    icount = ifa;
+	  else if(fadc_params[ifa].type == UITF_INTEGRATING)
+	    iint = ifa;
 	}
 
-      faSetProcMode(fadc_params[ifa].slot,
-		    fadc_params[ifa].mode,
-		    fadc_params[ifa].pl,
-		    fadc_params[ifa].ptw,
-		    fadc_params[ifa].nsb,
-		    fadc_params[ifa].nsa,
-		    fadc_params[ifa].np,
-		    0);
+      int32_t iflag = fadc_params[icount].sd_fp_address;
+      iflag |= fadc_params[icount].init_arg;
+      iflag |= FA_INIT_USE_ADDRLIST;
 
-      if(fadc_params[ifa].type == UITF_INTEGRATING)
-	{
-	  faSetMottDelay(fadc_params[ifa].slot, 8, fadc_params[ifa].delay8);
-	  faSetMottDelay(fadc_params[ifa].slot, 9, fadc_params[ifa].delay9);
-	  faSetMottDelay(fadc_params[ifa].slot, 11, fadc_params[ifa].delay11);
-	}
+      for(ifa = 0; (ifa < uitf_nfadc) && (ifa < FA_MAX_BOARDS); ifa++)
+	fadcAddrList[ifa] = fadc_params[ifa].address;
+
+      vmeSetQuietFlag(1);
+      fadcA32Base = 0x08800000;
+      stat = faInit(fadcAddrList[0], 0, uitf_nfadc, iflag);
+      faDisableMultiBlock();
+      vmeSetQuietFlag(0);
 
-	/* Enable hitbits for scalers and CTP */
-      faSetHitbitsMode(fadc_params[ifa].slot, 1);
+      if(nfadc != uitf_nfadc)
+	printf("%s: ERROR: %d of %d fadc250s initialized\n", __func__, nfadc, uitf_nfadc);
+
+      if(iint >= 0)
+	faSDC_Init_Integrating(fadc_params[iint].sd_fp_address);
     }
 
+  /* Helicity decoder: independent of the fadc250s.  Started after
+     faInit, which runs with the (global) jvme quiet flag set */
   if(hd_params.enabled)
     {
-      hdSetA32(0x09800000);
-      stat = hdInit(hd_params.address, HD_INIT_FP, HD_INIT_EXTERNAL_FIBER, 0);
+      snprintf(task[ntask].name, sizeof(task[ntask].name), "helicity_decoder");
+      task[ntask].func = uitf_config_hd_task;
+      uitf_init_task_start(&task[ntask++]);
+    }
 
-      hdSetProcDelay(hd_params.input_delay, hd_params.trigger_latency_delay);
+  /* Program/Init VME Modules Here */
+  for(ifa = 0; ifa < uitf_nfadc; ifa++)
+    {
+      snprintf(task[ntask].name, sizeof(task[ntask].name), "fadc250 %s slot %d",
+	       uitf_fadc_type_names[fadc_params[ifa].type], fadc_params[ifa].slot);
+      task[ntask].func = uitf_config_fadc_task;
+      task[ntask].arg = ifa;
+      uitf_init_task_start(&task[ntask++]);
+    }
 
-      hdSetBlocklevel(ti_params.blocklevel);
+  for(itask = 0; itask < ntask; itask++)
+    uitf_init_task_join(&task[itask]);
 
-      /* Enable the module decoder, well before triggers are enabled */
-      hdEnableDecoder();
+  /* The TI is initialized by tiprimary_list.c at every Download */
+  uitf_config_ti_program();
 
-      if(hd_params.use_internal_helicity)
-	{
-	  hdSetHelicitySource(1, 0, 1);
-	  hdHelicityGeneratorConfig(hd_params.internal.helicity_pattern,
-				    hd_params.internal.window_delay,
-				    hd_params.internal.settle_time,
-				    hd_params.internal.stable_time,
-				    hd_params.internal.seed);
-	  hdEnableHelicityGenerator();
-	}
+  ns = uitf_config_now() - start;
+  for(itask = 0; itask < ntask; itask++)
+    {
+      printf("%s: %-28s %s  %8.3f ms\n", __func__, task[itask].name,
+	     (task[itask].rval == OK) ? "OK   " : "ERROR",
+	     task[itask].ns / 1e6);
+      if(task[itask].rval != OK)
+	stat = ERROR;
     }
+  printf("%s: %-28s        %8.3f ms\n", __func__, "total", ns / 1e6);
+
+  /* faInit and hdInit status were not checked before.  Only the fadc250
+     DAC/threshold readback fails the init */
+  for(itask = 0; itask < ntask; itask++)
+    if((task[itask].func == uitf_config_fadc_task) && (task[itask].rval != OK))
+      return ERROR;
+
+  /* Remember what was applied */
+  hd_applied = hd_params;
+  memcpy(fadc_applied, fadc_params, uitf_nfadc * sizeof(fadc_config_t));
+  uitf_applied_nfadc = uitf_nfadc;
+  uitf_applied_blocklevel = ti_params.blocklevel;
+  uitf_applied_hash = uitf_config_hash;
+  uitf_applied = 1;
 
   return OK;
 }
@@ -10,6 +10,14 @@
 
 #include <stdint.h>
 
+/* vmeDmaConfig(addrmode, datamode, sstmode) for a module's block reads */
+typedef struct
+{
+  uint32_t addrmode;		/* 0 A16, 1 A24, 2 A32 */
+  uint32_t datamode;		/* 0 D16, 1 D32, 2 BLK32, 3 MBLK, 4 2eVME, 5 2eSST */
+  uint32_t sstmode;		/* 0 SST160, 1 SST267, 2 SST320 */
+} dma_config_t;
+
 typedef struct
 {
   uint32_t period;
@@ -36,8 +44,10 @@ typedef struct
   uint32_t bufferlevel;
   uint32_t prescale;
   trigger_rule_t rule[4];
+  uint32_t nrule;		/* rules in the config */
   random_pulser_t random;
   fixed_pulser_t fixed;
+  dma_config_t dma;
 } ti_config_t;
 
 
@@ -59,6 +69,10 @@ typedef struct
   uint32_t trigger_latency_delay;
   uint32_t use_internal_helicity;
   internal_helicity_t internal;
+
+  uint32_t ready_timeout_ns;
+  uint32_t words_per_event;
+  dma_config_t dma;
 } hd_config_t;
 
 typedef struct
@@ -84,15 +98,81 @@ typedef struct
   uint32_t threshold[16];
   uint32_t dac[16];
 
+  uint32_t ready_timeout_ns;
+  uint32_t max_words;		/* DMA limit per block.  0: from mode, ptw, np */
+  dma_config_t dma;
 } fadc_config_t;
 
+typedef struct
+{
+  uint32_t chained_dma;
+  uint32_t async_status;
+  uint32_t perf_interval;
+
+  uint32_t readout_mode;	/* UITF_READOUT_POLL, _INTERRUPT, _AUTO (from the
+				   previous run's rate, at Download) */
+  uint32_t poll_above_hz;	/* auto: trigger rate to switch to poll */
+  uint32_t interrupt_below_hz;	/* auto: trigger rate to switch back to interrupt */
+
+  uint32_t event_pool;		/* event buffers.  0: 4 x ti bufferlevel */
+
+  uint32_t pipeline;		/* HD and FADC blocks read ahead by a prefetch thread */
+  uint32_t pipeline_depth;	/* blocks read ahead.  0: 4 */
+
+  uint32_t sync_check;		/* check for leftover data in SYNC events (default 1) */
+  uint32_t sync_budget_us;	/* time to drain leftover data, then reset.  0: default */
+
+  uint32_t recovery;		/* resync a module after a block error (default 0) */
+  uint32_t recovery_budget_ms;	/* time with triggers off for a resync.  0: default */
+  uint32_t recovery_max;	/* resyncs per run, then only logged.  0: default */
+
+  uint32_t asym;		/* helicity-correlated sums of the integrating fadc250s */
+  uint32_t asym_interval;	/* seconds between asymmetry summaries.  0: 1 */
+  uint32_t asym_pattern;	/* UITF_ASYM_PATTERN_INTERNAL, or 1 + helicity pattern
+				   of the external helicity signals */
+
+  uint32_t pulse;		/* fadc250 raw windows to pulse parameters in the ROC */
+  uint32_t pulse_raw_prescale;	/* keep the raw bank every N blocks.  0: never */
+
+  uint32_t full_init;		/* always fully init the modules at Download */
+} readout_config_t;
+
+#define UITF_FADC_NCHAN 16
+#define UITF_FADC_MAX   20	/* fadc250s in the config */
+
 enum
   {
     UITF_COUNTING = 0,
     UITF_INTEGRATING = 1
   };
 
+enum
+  {
+    UITF_READOUT_POLL = 0,
+    UITF_READOUT_INTERRUPT = 1,
+    UITF_READOUT_AUTO = 2
+  };
+
+#define UITF_POLL_ABOVE_HZ      2000
+#define UITF_INTERRUPT_BELOW_HZ 1000
+#define UITF_SYNC_BUDGET_US     2000
+#define UITF_RECOVERY_BUDGET_MS 20
+#define UITF_RECOVERY_MAX       10
+#define UITF_ASYM_INTERVAL      1
+
+/* readout.asym_pattern: "internal" (internal_helicity.helicity_pattern),
+   or the pattern of the external helicity signals */
+#define UITF_ASYM_PATTERN_INTERNAL 0
+
+/* Binary image of the parsed config, next to the config file */
+#define UITF_CONFIG_CACHE_SUFFIX ".cache"
+
 int32_t uitf_config_init(char *filename);
 int32_t uitf_config_parse();
+int32_t uitf_config_validate();
 int32_t uitf_config_modules_init();
+void    uitf_config_modules_invalidate();
 int32_t uitf_config_modules_prestart();
+int32_t uitf_config_fadc_block_words(fadc_config_t *fa, uint32_t blocklevel,
+				     int32_t *fixed);
+int32_t uitf_config_hd_block_words(uint32_t blocklevel);
@@ -0,0 +1,279 @@
+/*************************************************************************
+ *
+ *  uitf_errlog.c - Error logging from the readout thread
+ *
+ *    The producer (rocTrigger) only does a few stores and an atomic
+ *    release of the ring head: no locks and no syscalls.  If the ring
+ *    is full the record is dropped but still counted.  Draining
+ *    (thread or uitfErrLogFlush) is serialized with errMutex.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "uitf_errlog.h"
+
+static const uitf_errclass_t *errClass = NULL;
+static int32_t errNclass = 0;
+
+static uitf_errrec_t errRing[UITF_ERRLOG_NREC];
+static uint32_t errHead = 0;	/* written by the producer */
+static uint32_t errTail = 0;	/* written by the drain */
+
+static uint64_t errCount[UITF_ERRLOG_MAXCLASS];
+static uint64_t errDropped[UITF_ERRLOG_MAXCLASS];
+
+/* Rate limiting, per class.  Drain side only */
+typedef struct
+{
+  uint64_t last_ns;
+  uint32_t suppressed;
+  uitf_errrec_t last;
+} uitf_errstate_t;
+static uitf_errstate_t errState[UITF_ERRLOG_MAXCLASS];
+
+static pthread_mutex_t errMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t *errPrintLock = NULL;	/* taken before errMutex */
+static pthread_t errThread;
+static volatile int32_t errRunning = 0;
+
+static uint64_t
+uitfErrNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+uitfErrPrintRec(const uitf_errrec_t *rec, uint32_t repeats)
+{
+  printf("%s: ERROR: ", errClass[rec->cls].name);
+  printf(errClass[rec->cls].fmt, rec->event, rec->arg0, rec->arg1);
+  if(repeats)
+    printf("  (%u more since last report)", repeats);
+  printf("\n");
+}
+
+/* Print (or suppress) everything in the ring.  Call with errMutex held.
+   force: report pending suppressed counts now */
+static void
+uitfErrDrain(int32_t force)
+{
+  uint32_t head, cls;
+  uint64_t now = uitfErrNow(), period = UITF_ERRLOG_PERIOD_MS * 1000000ULL;
+  uitf_errstate_t *st;
+
+  head = __atomic_load_n(&errHead, __ATOMIC_ACQUIRE);
+  while(errTail != head)
+    {
+      uitf_errrec_t *rec = &errRing[errTail & (UITF_ERRLOG_NREC - 1)];
+      st = &errState[rec->cls];
+
+      if((st->last_ns == 0) || ((now - st->last_ns) >= period))
+	{
+	  uitfErrPrintRec(rec, st->suppressed);
+	  st->last_ns = now;
+	  st->suppressed = 0;
+	}
+      else
+	{
+	  st->last = *rec;
+	  st->suppressed++;
+	}
+
+      __atomic_store_n(&errTail, errTail + 1, __ATOMIC_RELEASE);
+    }
+
+  for(cls = 0; cls < (uint32_t)errNclass; cls++)
+    {
+      st = &errState[cls];
+      if(st->suppressed && (force || ((now - st->last_ns) >= period)))
+	{
+	  uitfErrPrintRec(&st->last, st->suppressed - 1);
+	  st->last_ns = now;
+	  st->suppressed = 0;
+	}
+    }
+
+  fflush(stdout);
+}
+
+static void *
+uitfErrLogThread(void *arg)
+{
+  struct timespec ts = {0, UITF_ERRLOG_DRAIN_MS * 1000000L};
+
+  /* Below the readout thread */
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+
+  while(errRunning)
+    {
+      nanosleep(&ts, NULL);
+
+      if(errPrintLock)
+	pthread_mutex_lock(errPrintLock);
+      pthread_mutex_lock(&errMutex);
+      uitfErrDrain(0);
+      pthread_mutex_unlock(&errMutex);
+      if(errPrintLock)
+	pthread_mutex_unlock(errPrintLock);
+    }
+
+  return NULL;
+}
+
+/**
+ * @details Set the error classes, and start the drain thread
+ * @param[in] classes Name and format of each error class
+ * @param[in] nclass Number of classes (up to UITF_ERRLOG_MAXCLASS)
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+uitfErrLogInit(const uitf_errclass_t *classes, int32_t nclass)
+{
+  if((classes == NULL) || (nclass <= 0) || (nclass > UITF_ERRLOG_MAXCLASS))
+    {
+      printf("%s: ERROR: Invalid error classes (%d)\n", __func__, nclass);
+      return -1;
+    }
+
+  uitfErrLogClose();
+
+  errClass = classes;
+  errNclass = nclass;
+  uitfErrLogReset();
+
+  errRunning = 1;
+  if(pthread_create(&errThread, NULL, uitfErrLogThread, NULL) != 0)
+    {
+      printf("%s: ERROR creating drain thread.  Errors printed at uitfErrLogFlush\n",
+	     __func__);
+      errRunning = 0;
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * @details Clear the ring and counters.  Not while the producer is running.
+ */
+void
+uitfErrLogReset()
+{
+  pthread_mutex_lock(&errMutex);
+  errTail = __atomic_load_n(&errHead, __ATOMIC_ACQUIRE);
+  memset(errCount, 0, sizeof(errCount));
+  memset(errDropped, 0, sizeof(errDropped));
+  memset(errState, 0, sizeof(errState));
+  pthread_mutex_unlock(&errMutex);
+}
+
+/**
+ * @details Record an error.  Single producer (the readout thread).
+ * @param[in] cls Error class (index to the classes from uitfErrLogInit)
+ * @param[in] event Event number
+ * @param[in] arg0 First argument to the class format
+ * @param[in] arg1 Second argument to the class format
+ */
+void
+uitfErrLog(uint32_t cls, int32_t event, int32_t arg0, int32_t arg1)
+{
+  uint32_t head = errHead;
+  uitf_errrec_t *rec;
+
+  if(cls >= (uint32_t)errNclass)
+    return;
+
+  __atomic_store_n(&errCount[cls], errCount[cls] + 1, __ATOMIC_RELAXED);
+
+  if((head - __atomic_load_n(&errTail, __ATOMIC_ACQUIRE)) >= UITF_ERRLOG_NREC)
+    {
+      __atomic_store_n(&errDropped[cls], errDropped[cls] + 1, __ATOMIC_RELAXED);
+      return;
+    }
+
+  rec = &errRing[head & (UITF_ERRLOG_NREC - 1)];
+  rec->cls = cls;
+  rec->event = event;
+  rec->arg0 = arg0;
+  rec->arg1 = arg1;
+
+  __atomic_store_n(&errHead, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @details Print what is in the ring, and the pending suppressed counts
+ */
+void
+uitfErrLogFlush()
+{
+  if(errClass == NULL)
+    return;
+
+  if(errPrintLock)
+    pthread_mutex_lock(errPrintLock);
+  pthread_mutex_lock(&errMutex);
+  uitfErrDrain(1);
+  pthread_mutex_unlock(&errMutex);
+  if(errPrintLock)
+    pthread_mutex_unlock(errPrintLock);
+}
+
+/**
+ * @details Lock held while the ring is printed, so the lines stay out of
+ *          stdout captured by other threads (DALMAGO)
+ * @param[in] lock Mutex, or NULL for none.  Not to be held when calling
+ *            uitfErrLogFlush.
+ */
+void
+uitfErrLogSetPrintLock(pthread_mutex_t *lock)
+{
+  errPrintLock = lock;
+}
+
+/**
+ * @details Print the error counters for each class
+ */
+void
+uitfErrLogPrint()
+{
+  int32_t cls;
+  uint64_t count, dropped;
+
+  for(cls = 0; cls < errNclass; cls++)
+    {
+      count = __atomic_load_n(&errCount[cls], __ATOMIC_RELAXED);
+      dropped = __atomic_load_n(&errDropped[cls], __ATOMIC_RELAXED);
+      if(count == 0)
+	continue;
+
+      printf("%s: %-12s %llu", __func__, errClass[cls].name,
+	     (unsigned long long)count);
+      if(dropped)
+	printf("  (%llu not logged, ring full)", (unsigned long long)dropped);
+      printf("\n");
+    }
+}
+
+/**
+ * @details Flush, and stop the drain thread
+ */
+void
+uitfErrLogClose()
+{
+  if(errRunning)
+    {
+      errRunning = 0;
+      pthread_join(errThread, NULL);
+    }
+
+  uitfErrLogFlush();
+}
@@ -0,0 +1,42 @@
+#pragma once
+/*************************************************************************
+ *
+ *  uitf_errlog.h - Error logging from the readout thread
+ *
+ *    rocTrigger fills fixed size records into a lock-free single
+ *    producer ring.  A low priority thread drains the ring and prints,
+ *    at most one line per error class per period, with the number of
+ *    repeats it suppressed.
+ *
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define UITF_ERRLOG_NREC      1024	/* ring size, power of 2 */
+#define UITF_ERRLOG_MAXCLASS    16
+#define UITF_ERRLOG_PERIOD_MS 1000	/* print at most once per class per period */
+#define UITF_ERRLOG_DRAIN_MS   100	/* drain thread wake up */
+
+/* fmt is printed with (event, arg0, arg1) */
+typedef struct
+{
+  const char *name;
+  const char *fmt;
+} uitf_errclass_t;
+
+typedef struct
+{
+  uint32_t cls;
+  int32_t  event;
+  int32_t  arg0;
+  int32_t  arg1;
+} uitf_errrec_t;
+
+int32_t uitfErrLogInit(const uitf_errclass_t *classes, int32_t nclass);
+void    uitfErrLogReset();
+void    uitfErrLog(uint32_t cls, int32_t event, int32_t arg0, int32_t arg1);
+void    uitfErrLogFlush();
+void    uitfErrLogSetPrintLock(pthread_mutex_t *lock);
+void    uitfErrLogPrint();
+void    uitfErrLogClose();
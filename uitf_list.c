@@ -10,7 +10,8 @@
  *
  */
 
-/* Event Buffer definitions */
+/* Event Buffer definitions.  Used by tiprimary_list.c, and as the
+   largest buffer allowed.  The pool is resized at Download (uitfEventPoolCreate) */
 #define MAX_EVENT_POOL     10
 #define MAX_EVENT_LENGTH   1024*64      /* Size in Bytes */
 
@@ -18,38 +19,1817 @@
 #define TI_MASTER
 #endif
 
-/* EXTernal trigger source (e.g. front panel ECL input), POLL for available data */
+/* EXTernal trigger source (e.g. front panel ECL input), POLL for available data.
+   readout.readout_mode in the config may switch to interrupts at Download.
+   May be set at build time (-DTI_READOUT=...) */
+#ifndef TI_READOUT
 #define TI_READOUT TI_READOUT_EXT_POLL
+#endif
+
+/* TI VME address (Slot 3) */
+#define TI_ADDR  (3 << 19)
+
+#define FIBER_LATENCY_OFFSET 0x10
+
+ /* Source required for CODA readout lists using the TI */
+#include "dmaBankTools.h"
+#include "tiprimary_list.c"
+
+#ifndef TI_FLAG
+#define TI_FLAG 0
+#endif
+
+/* Library to pipe stdout to daLogMsg */
+#include "dalmaRolLib.h"
+
+/* Event type 137 code */
+#include "rocUtils.c"
+
+/* uitf config library */
+#include "uitf_config.c"
+
+/* Deadline based block ready waits */
+#include "uitf_wait.c"
+uitf_wait_t hdWait, faWait, chainWait;
+
+/* Module status dumps off the transition path */
+#include "uitf_status.c"
+
+/* DALMAGO sends all of stdout to daLogMsg, whichever thread prints.
+   Printing from the status thread, the error log drain and the
+   transitions is serialized with this, so no capture takes in lines
+   from another. */
+pthread_mutex_t uitfPrintMutex = PTHREAD_MUTEX_INITIALIZER;
+#define UITF_DALMAGO   pthread_mutex_lock(&uitfPrintMutex); DALMAGO
+#define UITF_DALMASTOP DALMASTOP; pthread_mutex_unlock(&uitfPrintMutex)
+
+/* Error logging from rocTrigger */
+#include "uitf_errlog.c"
+enum
+  {
+    UITF_ERR_TI_DATA,
+    UITF_ERR_HD_TIMEOUT,
+    UITF_ERR_HD_READ,
+    UITF_ERR_FA_TIMEOUT,
+    UITF_ERR_FA_BLOCK,
+    UITF_ERR_CHAIN,
+    UITF_ERR_SYNC_TI,
+    UITF_ERR_SYNC_HD,
+    UITF_ERR_SYNC_FA,
+    UITF_ERR_PIPE_TIMEOUT,
+    UITF_ERR_SYNC_PIPE,
+    UITF_ERR_SYNC_RESET,
+    UITF_ERR_RECOVER,
+    UITF_ERR_HD_TRUNC,
+    UITF_ERR_PULSE,
+    UITF_ERR_FA_TRUNC,
+    UITF_ERR_NCLASS
+  };
+const uitf_errclass_t uitfErrClass[UITF_ERR_NCLASS] =
+  {
+    {"TI_DATA",    "Event %d: No TI Trigger data or error.  dCnt = %d"},
+    {"HD_TIMEOUT", "Event %d: TIMEOUT waiting for Helicity Decoder Block Ready"},
+    {"HD_READ",    "Event %d: ERROR or NO data from hdReadBlock(...) = %d"},
+    {"FA_TIMEOUT", "Event %d: TIMEOUT waiting for FADC (slot = %d) Block Ready"},
+    {"FA_BLOCK",   "Event %d: Slot %d: error in transfer, dCnt = 0x%x"},
+    {"CHAIN",      "Event %d: chained DMA returned %d of %d bytes or an incomplete block"},
+    {"SYNC_TI",    "Event %d: TI Data available (%d) after readout in SYNC event"},
+    {"SYNC_HD",    "Event %d: Helicity Decoder Data available (%d) after readout in SYNC event"},
+    {"SYNC_FA",    "Event %d: fADC250 Data available (%d) in slot %d after readout in SYNC event"},
+    {"PIPE_TIMEOUT", "Event %d: TIMEOUT waiting for prefetched HD/FADC block"},
+    {"SYNC_PIPE",  "Event %d: Prefetched blocks (%d) left after readout in SYNC event"},
+    {"SYNC_RESET", "Event %d: SYNC drain budget exceeded.  Module 0x%x reset (%d words drained)"},
+    {"RECOVER",    "Event %d: Resync of modules (slot mask 0x%x), status %d"},
+    {"HD_TRUNC",   "Event %d: Helicity Decoder block cut short (%d words, limit %d)"},
+    {"PULSE",      "Event %d: fadc250 pulse data does not fit (%d raw words).  Raw bank kept"},
+    {"FA_TRUNC",   "Event %d: Slot %d: fadc250 block cut short at the DMA limit (%d words)"}
+  };
+
+/* Per stage timing of rocTrigger */
+#include "uitf_perf.c"
+enum
+  {
+    UITF_PERF_TI_READ,
+    UITF_PERF_HD_WAIT,
+    UITF_PERF_HD_DMA,
+    UITF_PERF_FA_WAIT,
+    UITF_PERF_FA_DMA,
+    UITF_PERF_FA_BLKERR,
+    UITF_PERF_CHAIN,
+    UITF_PERF_PIPE,
+    UITF_PERF_SYNC,
+    UITF_PERF_ASYM,
+    UITF_PERF_PULSE,
+    UITF_PERF_TRIGGER,
+    UITF_PERF_NSTAGE
+  };
+const char *uitfPerfName[UITF_PERF_NSTAGE] =
+  {
+    "TI_READ", "HD_WAIT", "HD_DMA", "FA_WAIT", "FA_DMA", "FA_BLKERR",
+    "CHAIN", "PIPE", "SYNC", "ASYM", "PULSE",
+    "TRIGGER"
+  };
+/* Timing histograms, written every readout.perf_interval seconds */
+const uint32_t UITF_PERF_BANK = 0x0E0F;
+#define UITF_PERF_MAXWORDS (2 + UITF_PERF_NSTAGE * (3 + UITF_PERF_NBINS))
+
+/* SYNC event drain diagnostics, written when there was leftover data */
+const uint32_t UITF_SYNC_BANK = 0x0E10;
+#define UITF_SYNC_VERSION  1
+#define UITF_SYNC_MAXMOD   (2 + UITF_FADC_MAX)	/* TI, HD, fadc250s */
+#define UITF_SYNC_MAXWORDS (2 + UITF_SYNC_MAXMOD * 5)
+
+/* Resync marker (uitfRecover) */
+const uint32_t UITF_RECOVER_BANK = 0x0E11;
+#define UITF_RECOVER_VERSION  2
+#define UITF_RECOVER_MAXWORDS 6
+
+/* Helicity-correlated sums (readout.asym) */
+#include "uitf_asym.c"
+/* Asymmetry summary, written every readout.asym_interval seconds */
+const uint32_t UITF_ASYM_BANK = 0x0E12;
+int32_t uitfAsym = 0;		/* Set at Download (uitfAsymSetup) */
+
+/* fadc250 raw windows to pulse parameters (readout.pulse) */
+#include "uitf_pulse.c"
+const uint32_t UITF_PULSE_BANK = 0x0251;
+int32_t uitfPulse = 0;		/* Set at Download (uitfPulseSetup) */
+volatile uint32_t *uitfPulseBuf = NULL;
+int32_t uitfPulseWords = 0;	/* Largest pulse bank */
+uint32_t uitfPulseBlocks = 0;	/* blocks reduced, for pulse_raw_prescale */
+
+/* fadc library*/
+#include "fadcLib.h"
+/* Largest fadc250 block for the configured processing mode. Set at Download */
+int32_t MAXFADCWORDS = 0;
+
+/* Event buffer size (bytes) and pool depth for this run.  Set at Download */
+#define UITF_EVENT_POOL_MAX 256
+int32_t uitfEventLength = MAX_EVENT_LENGTH;
+int32_t uitfEventPoolDepth = MAX_EVENT_POOL;
+/* Room for the buffer header words and rounding, in bytes */
+#define UITF_EVENT_SLACK    256
+const uint32_t FADC250_DECODER_BANK = 0X0250;
+
+/* helicity decoder library */
+#include "hdLib.h"
+const uint32_t HELICITY_DECODER_BANK = 0xDEC;
+
+// runtype set by user string at Download.  default to counting
+int32_t UITF_RUN_TYPE = UITF_COUNTING;
+
+/* fadc250s of the run type (index to fadc_params), from uitfFadcSelect.
+   uitfFa is the first of them */
+int32_t uitfFaIndex[UITF_FADC_MAX];
+int32_t uitfFaN = 0;
+fadc_config_t *uitfFa = NULL;
+
+/* DMA engine state last written with vmeDmaConfig.  Invalidated at Go,
+   so it is written once per run, and again only if a module's dma
+   settings differ from the last one read */
+dma_config_t uitfDmaApplied;
+int32_t uitfDmaValid = 0;
+uint32_t uitfDmaNconfig = 0;
+
+static inline void
+uitfDmaSelect(const dma_config_t *dma)
+{
+  if(uitfDmaValid &&
+     (dma->addrmode == uitfDmaApplied.addrmode) &&
+     (dma->datamode == uitfDmaApplied.datamode) &&
+     (dma->sstmode == uitfDmaApplied.sstmode))
+    return;
+
+  /*
+   *  vmeDmaConfig(addrType, dataType, sstMode);
+   *
+   *  addrType = 0 (A16)    1 (A24)    2 (A32)
+   *  dataType = 0 (D16)    1 (D32)    2 (BLK32) 3 (MBLK) 4 (2eVME) 5 (2eSST)
+   *  sstMode  = 0 (SST160) 1 (SST267) 2 (SST320)
+   */
+  vmeDmaConfig(dma->addrmode, dma->datamode, dma->sstmode);
+  uitfDmaApplied = *dma;
+  uitfDmaValid = 1;
+  uitfDmaNconfig++;
+}
+
+/* TI readout mode of the last run, and its trigger rate (Hz, 0 if unknown).
+   Kept across runs for readout_mode = "auto" */
+int32_t uitfTiReadout = TI_READOUT;
+uint32_t uitfLastRate = 0;
+uint64_t uitfGoTime = 0;
+
+/* Pick poll or interrupt readout for this run.  tiprimary_list.c has just
+   initialized (and configured) the TI with TI_READOUT.  If the mode differs,
+   tiInit is redone with TI_INIT_NO_INIT: only the library's readout mode
+   changes, and the TI registers tiprimary_list.c set are kept.
+   The mode can not change during a run, so auto mode goes by the rate of
+   the previous run, with hysteresis between interrupt_below_hz and
+   poll_above_hz */
+static int32_t
+uitfReadoutModeSelect()
+{
+  int32_t mode = TI_READOUT_EXT_POLL;
+
+  switch(readout_params.readout_mode)
+    {
+    case UITF_READOUT_INTERRUPT:
+      mode = TI_READOUT_EXT_INT;
+      break;
+
+    case UITF_READOUT_AUTO:
+      if(uitfLastRate == 0)
+	mode = (UITF_RUN_TYPE == UITF_COUNTING) ? TI_READOUT_EXT_POLL : TI_READOUT_EXT_INT;
+      else if(uitfLastRate >= readout_params.poll_above_hz)
+	mode = TI_READOUT_EXT_POLL;
+      else if(uitfLastRate <= readout_params.interrupt_below_hz)
+	mode = TI_READOUT_EXT_INT;
+      else
+	mode = uitfTiReadout;
+      break;
+
+    case UITF_READOUT_POLL:
+    default:
+      mode = TI_READOUT_EXT_POLL;
+    }
+
+  if(mode != TI_READOUT)
+    {
+      if(tiInit(TI_ADDR, mode, TI_FLAG | TI_INIT_NO_INIT) != OK)
+	{
+	  daLogMsg("ERROR", "TI init for %s readout failed",
+		   (mode == TI_READOUT_EXT_INT) ? "interrupt" : "poll");
+	  return -1;
+	}
+    }
+
+  uitfTiReadout = mode;
+
+  printf("%s: TI %s readout (last run %d Hz)\n", __func__,
+	 (mode == TI_READOUT_EXT_INT) ? "interrupt" : "poll", uitfLastRate);
+
+  return 0;
+}
+
+static int32_t
+uitfHdReady(int32_t arg)
+{
+  return hdBReady();
+}
+
+static int32_t
+uitfFaReady(int32_t slot)
+{
+  return faBready(slot);
+}
+
+/* Chained (linked list) DMA of the helicity decoder and fadc250 blocks.
+   Block sizes must be fixed, since a descriptor has to stop exactly at
+   the end of its block.  Set at Download. */
+int32_t uitfChainedDma = 0;
+uint32_t uitfChainHdWords = 0, uitfChainFaWords = 0;
+uint32_t uitfChainErrors = 0;
+
+/* Pipelined readout (uitfPipeSetup).  Set at Download */
+int32_t uitfPipeline = 0;
+
+/* Module readout path of a rocTrigger variant (uitfTriggerSelect) */
+enum
+  {
+    UITF_PATH_DIRECT = 0,	/* one module at a time */
+    UITF_PATH_CHAIN = 1,	/* chained DMA, then one at a time if not ready */
+    UITF_PATH_PIPE = 2		/* from the prefetch thread */
+  };
+
+/* Buffer for data that is read and dropped (uitfSyncSetup) */
+DMA_MEM_ID vmeSYNC = 0;
+DMANODE *uitfSyncScratch = NULL;
+int32_t uitfSyncScratchWords = 0;
+
+/* Slot bits of the modules to resync at the end of this block, and of
+   those that may still hold (the rest of) this block (uitfRecover) */
+uint32_t uitfRecoverMask = 0, uitfRecoverUnread = 0;
+
+static inline void
+uitfRecoverRequest(int32_t slot, int32_t unread)
+{
+  if(readout_params.recovery)
+    {
+      uitfRecoverMask |= (1u << (slot & 0x1f));
+      if(unread)
+	uitfRecoverUnread |= (1u << (slot & 0x1f));
+    }
+}
+
+static int32_t
+uitfChainReady(int32_t slot)
+{
+  return ((hdBReady() == 1) && (faBready(slot) == 1));
+}
+
+static int32_t
+uitfChainSetup()
+{
+  int32_t hdwords, fawords, fixed = 0;
+
+  uitfChainedDma = 0;
+  if(readout_params.chained_dma == 0)
+    return 0;
+
+  if(uitfPipeline)
+    {
+      printf("%s: WARN: chained_dma not used with the pipelined readout.\n",
+	     __func__);
+      return 0;
+    }
+
+  if(hd_params.enabled == 0)
+    {
+      printf("%s: WARN: chained_dma needs the helicity decoder. Disabled.\n",
+	     __func__);
+      return 0;
+    }
+
+  if(uitfFaN > 1)
+    {
+      printf("%s: WARN: chained_dma reads one fadc250.  Disabled for %d.\n",
+	     __func__, uitfFaN);
+      return 0;
+    }
+
+  /* One vmeDmaConfig for the whole list */
+  if(memcmp(&hd_params.dma, &uitfFa->dma, sizeof(dma_config_t)) != 0)
+    {
+      daLogMsg("WARN", "chained_dma needs the same dma settings for HD and FADC. Disabled.");
+      return 0;
+    }
+
+  hdwords = uitf_config_hd_block_words(ti_params.blocklevel);
+  fawords = uitf_config_fadc_block_words(uitfFa, ti_params.blocklevel, &fixed);
+  if((hdwords < 0) || (fawords < 0) || (fixed == 0))
+    {
+      daLogMsg("WARN",
+	       "chained_dma needs fixed block sizes (hd words_per_event, fadc mode 1). Disabled.");
+      return 0;
+    }
+
+  if(((hdwords + fawords + 4) << 2) > (uitfEventLength - UITF_EVENT_SLACK))
+    {
+      daLogMsg("WARN", "chained_dma: %d + %d words exceeds event buffer. Disabled.",
+	       hdwords, fawords);
+      return 0;
+    }
+
+  uitfChainHdWords = hdwords;
+  uitfChainFaWords = fawords;
+  uitfChainedDma = 1;
+
+  printf("%s: Chained DMA: HD %d words + FADC %d words per block\n",
+	 __func__, hdwords, fawords);
+
+  return 0;
+}
+
+/* Check that a block ends with a block trailer reporting nwords */
+static int32_t
+uitfBlockComplete(volatile uint32_t *block, uint32_t nwords)
+{
+  uint32_t itrailer = nwords - 1;
+
+  /* Skip the filler word */
+  if((block[itrailer] & 0xf8000000) == 0xf8000000)
+    itrailer--;
+
+  return (((block[itrailer] & 0xf8000000) == 0x88000000) &&
+	  ((block[itrailer] & 0x3fffff) == (itrailer + 1)));
+}
+
+/*
+ * Read the helicity decoder and fadc250 blocks in one linked list DMA.
+ *
+ * The transfer lands 4 words past the HD bank header, so the fadc250
+ * block already sits after room for its own bank header.  The (small)
+ * HD block is then moved down 2 words into its bank.
+ *
+ * Returns 0 if read, -1 if the modules were not ready (nothing read).
+ */
+static int32_t
+uitfChainedReadout(int32_t ev_num)
+{
+  int32_t slot = uitfFa->slot;
+  uint32_t vmeAdrs[2], dmaSize[2];
+  volatile uint32_t *hdblock, *fablock;
+  int32_t nbytes = 0, nwords, hdwords, fawords;
+
+  if(uitfWait(&chainWait, uitfChainReady, slot) != 0)
+    return -1;
+
+  uitfDmaSelect(&hd_params.dma);
+
+  vmeAdrs[0] = hdGetA32();
+  dmaSize[0] = uitfChainHdWords << 2;
+  vmeAdrs[1] = faGetA32(slot);
+  dmaSize[1] = uitfChainFaWords << 2;
+
+  BANKOPEN(HELICITY_DECODER_BANK, BT_UI4, blockLevel);
+
+  hdblock = dma_dabufp;
+
+  if((vmeDmaSetupLL((unsigned long)(dma_dabufp + 2), vmeAdrs, dmaSize, 2) == OK) &&
+     (vmeDmaSendLL() == OK))
+    nbytes = vmeDmaDone();
+
+  /* What arrived: the HD block, then the fadc250 block */
+  nwords = (nbytes > 0) ? (nbytes >> 2) : 0;
+  hdwords = (nwords < (int32_t)uitfChainHdWords) ? nwords : (int32_t)uitfChainHdWords;
+  fawords = nwords - hdwords;
+  if(fawords > (int32_t)uitfChainFaWords)
+    fawords = uitfChainFaWords;
+
+  memmove((void *)hdblock, (void *)(hdblock + 2), hdwords << 2);
+  dma_dabufp += hdwords;
+
+  BANKCLOSE;
+
+  /* The fadc250 block landed right after the HD block, which is now
+     where the data of its bank starts */
+  BANKOPEN(FADC250_DECODER_BANK, BT_UI4, blockLevel);
+  fablock = dma_dabufp;
+  dma_dabufp += fawords;
+  BANKCLOSE;
+
+  if((nbytes != (int32_t)(dmaSize[0] + dmaSize[1])) ||
+     !uitfBlockComplete(hdblock, uitfChainHdWords) ||
+     !uitfBlockComplete(fablock, uitfChainFaWords))
+    {
+      uitfChainErrors++;
+      uitfErrLog(UITF_ERR_CHAIN, ev_num, nbytes, dmaSize[0] + dmaSize[1]);
+      uitfRecoverRequest(hd_params.slot, !uitfBlockComplete(hdblock, uitfChainHdWords));
+      uitfRecoverRequest(slot, !uitfBlockComplete(fablock, uitfChainFaWords));
+    }
+
+  return 0;
+}
+
+/* TI trigger bank words per event (event number, timestamp) */
+#define UITF_TI_EVENT_WORDS 4
+/* Helicity decoder DMA limit, in words, if words_per_event is not set */
+#define UITF_HD_DEFAULT_WORDS (1024>>2)
+
+/* Helicity decoder DMA limit per block, from blocklevel and
+   helicity_decoder.words_per_event.  Set at Download */
+int32_t uitfHdMaxWords = UITF_HD_DEFAULT_WORDS;
+/* Event buffer words, and those needed after the HD bank.  Set at Download */
+int32_t uitfEventWords = 0, uitfHdTailWords = 0;
+/* Start of the block being built (set in rocTrigger) */
+volatile uint32_t *uitfBlockStart = NULL;
+/* HD and fadc250 blocks cut short by the DMA limit, this run */
+uint32_t uitfHdTruncated = 0, uitfFaTruncated = 0;
+
+/* HD DMA limit for this block: the decoder block size, bounded by what
+   is left of the event buffer after the banks still to come */
+static inline int32_t
+uitfHdReadLimit()
+{
+  int32_t left;
+
+  left = uitfEventWords - (int32_t)(dma_dabufp - uitfBlockStart) - uitfHdTailWords;
+  if(left < 0)
+    left = 0;
+
+  return (left < uitfHdMaxWords) ? left : uitfHdMaxWords;
+}
+
+/* A read that filled the limit without reaching the block trailer */
+static inline int32_t
+uitfBlockTruncated(volatile uint32_t *block, int32_t nwords, int32_t limit)
+{
+  return (nwords > 0) && (nwords >= limit) && !uitfBlockComplete(block, nwords);
+}
+
+/* Size the fadc250 DMA from the processing modes (the largest of the
+   boards read), and make sure a whole block (TI + HD + fadc250 banks)
+   fits in an event buffer */
+static int32_t
+uitfEventSizeCheck()
+{
+  int32_t tiwords, hdwords = 0, maxwords, ifa, fawords;
+
+  MAXFADCWORDS = 0;
+  for(ifa = 0; ifa < uitfFaN; ifa++)
+    {
+      fadc_config_t *fa = &fadc_params[uitfFaIndex[ifa]];
+
+      fawords = uitf_config_fadc_block_words(fa, ti_params.blocklevel, NULL);
+      if(fawords <= 0)
+	{
+	  daLogMsg("ERROR", "Cannot size fadc250 (slot %d) block for mode %d",
+		   fa->slot, fa->mode);
+	  return -1;
+	}
+      if(fawords > MAXFADCWORDS)
+	MAXFADCWORDS = fawords;
+    }
+
+  tiwords = 2 + ti_params.blocklevel * UITF_TI_EVENT_WORDS;
+  if(hd_params.enabled)
+    {
+      uitfHdMaxWords = uitf_config_hd_block_words(ti_params.blocklevel);
+      if(uitfHdMaxWords < 0)
+	{
+	  uitfHdMaxWords = UITF_HD_DEFAULT_WORDS;
+	  printf("%s: WARN: HD block size unknown (words_per_event).  DMA limit %d words\n",
+		 __func__, uitfHdMaxWords);
+	}
+      hdwords = 2 + uitfHdMaxWords + 2;
+    }
+
+  /* After the HD bank: fadc250 bank, then the diagnostics banks */
+  uitfHdTailWords = 2 + uitfFaN * MAXFADCWORDS;
+  if(readout_params.perf_interval)
+    uitfHdTailWords += 2 + UITF_PERF_MAXWORDS;
+  if(readout_params.sync_check)
+    uitfHdTailWords += 2 + UITF_SYNC_MAXWORDS;
+  if(readout_params.recovery)
+    uitfHdTailWords += 2 + UITF_RECOVER_MAXWORDS;
+  if(uitfAsym)
+    uitfHdTailWords += 2 + UITF_ASYM_MAXWORDS(uitfFaN);
+  /* The raw bank is kept in prescaled blocks, so room for both */
+  if(uitfPulse)
+    uitfHdTailWords += 2 + uitfPulseWords;
+  maxwords = tiwords + hdwords + uitfHdTailWords;
+
+  printf("%s: Max words per block: TI %d  HD %d  FADC %d x %d  total %d (%d bytes)\n",
+	 __func__, tiwords, hdwords, uitfFaN, MAXFADCWORDS, maxwords, maxwords << 2);
+
+  if((maxwords << 2) > MAX_EVENT_LENGTH)
+    {
+      daLogMsg("ERROR",
+	       "Max block size %d bytes > MAX_EVENT_LENGTH (%d). Lower blocklevel or ptw",
+	       maxwords << 2, MAX_EVENT_LENGTH);
+      return -1;
+    }
+
+  /* Whole cache lines */
+  uitfEventLength = ((maxwords << 2) + UITF_EVENT_SLACK + 63) & ~63;
+  if(uitfEventLength > MAX_EVENT_LENGTH)
+    uitfEventLength = MAX_EVENT_LENGTH;
+  uitfEventWords = uitfEventLength >> 2;
+
+  return 0;
+}
+
+/* Replace the vmeIN/vmeOUT pools made by tiprimary_list.c with ones sized
+   for this run: buffers from uitfEventSizeCheck, depth from
+   readout.event_pool (default 4 x bufferlevel, at least MAX_EVENT_POOL).
+   Each buffer is written once here so its pages are mapped before Go. */
+static int32_t
+uitfEventPoolCreate()
+{
+  DMANODE *node[UITF_EVENT_POOL_MAX];
+  int32_t inode, nnode = 0;
+
+  uitfEventPoolDepth = readout_params.event_pool;
+  if(uitfEventPoolDepth == 0)
+    {
+      uitfEventPoolDepth = 4 * ti_params.bufferlevel;
+      if(uitfEventPoolDepth < MAX_EVENT_POOL)
+	uitfEventPoolDepth = MAX_EVENT_POOL;
+    }
+  if(uitfEventPoolDepth > UITF_EVENT_POOL_MAX)
+    uitfEventPoolDepth = UITF_EVENT_POOL_MAX;
+
+  dmaPFree(vmeIN);
+  dmaPFree(vmeOUT);
+
+  vmeIN = dmaPCreate("vmeIN", uitfEventLength, uitfEventPoolDepth, 0);
+  vmeOUT = dmaPCreate("vmeOUT", 0, uitfEventPoolDepth, 0);
+  if((vmeIN == 0) || (vmeOUT == 0))
+    {
+      daLogMsg("ERROR", "Unable to allocate %d event buffers of %d bytes",
+	       uitfEventPoolDepth, uitfEventLength);
+      return -1;
+    }
+
+  dmaPReInitAll();
+
+  while((nnode < uitfEventPoolDepth) && ((node[nnode] = dmaPGetItem(vmeIN)) != NULL))
+    {
+      memset((void *)node[nnode]->data, 0, uitfEventLength - UITF_EVENT_SLACK);
+      nnode++;
+    }
+  for(inode = 0; inode < nnode; inode++)
+    dmaPFreeItem(node[inode]);
+
+  printf("%s: %d event buffers of %d bytes (%d pre-faulted)\n",
+	 __func__, uitfEventPoolDepth, uitfEventLength, nnode);
+
+  return 0;
+}
+
+/* Pipelined readout (readout.pipeline).  A prefetch thread reads the
+   helicity decoder and fadc250 blocks into a ring of buffers from the
+   vmePIPE pool, as soon as the modules have them.  rocTrigger reads the
+   TI block, then builds the banks from the oldest prefetched block, while
+   the thread is already reading the next one.  DMA from the two threads
+   is serialized with uitfDmaLock.
+   uitfPipeMutex only guards the thread's state (run, hold, busy, kicks),
+   and is never held while waiting on a module or during DMA.  The thread
+   sleeps on uitfPipeCond while the ring is full, while rocTrigger holds
+   it (uitfPipePause, for the SYNC event checks and the resync), and when
+   idle: after a ready timeout, until rocTrigger has the next TI block. */
+#define UITF_PIPE_IDLE_MS 10	/* longest idle sleep, without a kick */
+#define UITF_PIPE_MAX 16
+
+typedef struct
+{
+  DMANODE *node;
+  int32_t hdwords;
+  int32_t hdtrunc;		/* HD block cut short by the DMA limit */
+  int32_t faoffset;		/* fadc250 block, in words from the start */
+  int32_t fawords;
+  int32_t faerror;
+  int32_t fatrunc;		/* fadc250 block cut short by MAXFADCWORDS */
+} uitf_pipe_slot_t;
+
+uitf_pipe_slot_t uitfPipeSlot[UITF_PIPE_MAX];
+uint32_t uitfPipeDepth = 0;
+uint32_t uitfPipeHead = 0;	/* written by the prefetch thread */
+uint32_t uitfPipeTail = 0;	/* written by rocTrigger */
+volatile int32_t uitfPipeRun = 0, uitfPipeHold = 0;
+int32_t uitfPipeBusy = 0;	/* the thread is waiting on, or reading, a block */
+uint32_t uitfPipeKicks = 0;	/* rocTrigger: a new TI block, or a slot freed */
+pthread_t uitfPipeThread;
+pthread_mutex_t uitfPipeMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t uitfPipeCond = PTHREAD_COND_INITIALIZER;
+pthread_mutex_t uitfDmaLock = PTHREAD_MUTEX_INITIALIZER;
+DMA_MEM_ID vmePIPE = 0;
+uitf_wait_t pipeWait, prefetchWait;
+
+/* rocTrigger's DMA, if the prefetch thread also does DMA */
+#define UITF_DMA_LOCK(pipe)   { if(pipe) pthread_mutex_lock(&uitfDmaLock); }
+#define UITF_DMA_UNLOCK(pipe) { if(pipe) pthread_mutex_unlock(&uitfDmaLock); }
+
+static int32_t
+uitfPipeModulesReady(int32_t slot)
+{
+  /* A pause or a stop ends the wait */
+  if(uitfPipeHold || !uitfPipeRun)
+    return 1;
+
+  if(hd_params.enabled && (hdBReady() != 1))
+    return 0;
+
+  return (faBready(slot) == 1);
+}
+
+static int32_t
+uitfPipeReady(int32_t arg)
+{
+  return (__atomic_load_n(&uitfPipeHead, __ATOMIC_ACQUIRE) != uitfPipeTail);
+}
+
+/* Wake the prefetch thread: rocTrigger has a new TI block, or has freed
+   a ring slot */
+static void
+uitfPipeKick()
+{
+  pthread_mutex_lock(&uitfPipeMutex);
+  uitfPipeKicks++;
+  pthread_cond_broadcast(&uitfPipeCond);
+  pthread_mutex_unlock(&uitfPipeMutex);
+}
+
+static void *
+uitfPipePrefetch(void *arg)
+{
+  int32_t slot = uitfFa->slot, idle = 0;
+  uint32_t kicks = 0;
+  uitf_pipe_slot_t *ps;
+  volatile uint32_t *data;
+  struct timespec until;
+
+  while(1)
+    {
+      pthread_mutex_lock(&uitfPipeMutex);
+      uitfPipeBusy = 0;
+      pthread_cond_broadcast(&uitfPipeCond);
+
+      /* Idle: no block within the ready deadline.  Sleep until the next
+	 TI block (or UITF_PIPE_IDLE_MS) */
+      if(idle && (kicks == uitfPipeKicks) && uitfPipeRun && !uitfPipeHold)
+	{
+	  clock_gettime(CLOCK_REALTIME, &until);
+	  until.tv_nsec += UITF_PIPE_IDLE_MS * 1000000L;
+	  if(until.tv_nsec >= 1000000000L)
+	    {
+	      until.tv_sec++;
+	      until.tv_nsec -= 1000000000L;
+	    }
+	  pthread_cond_timedwait(&uitfPipeCond, &uitfPipeMutex, &until);
+	}
+
+      /* Ring full, or paused */
+      while(uitfPipeRun &&
+	    (uitfPipeHold ||
+	     ((uitfPipeHead - __atomic_load_n(&uitfPipeTail, __ATOMIC_ACQUIRE)) >= uitfPipeDepth)))
+	pthread_cond_wait(&uitfPipeCond, &uitfPipeMutex);
+
+      if(!uitfPipeRun)
+	{
+	  pthread_mutex_unlock(&uitfPipeMutex);
+	  break;
+	}
+      kicks = uitfPipeKicks;
+      uitfPipeBusy = 1;
+      pthread_mutex_unlock(&uitfPipeMutex);
+
+      /* Timeouts here only mean no block yet */
+      idle = (uitfWait(&prefetchWait, uitfPipeModulesReady, slot) != 0);
+      if(idle || uitfPipeHold || !uitfPipeRun)
+	continue;
+
+      ps = &uitfPipeSlot[uitfPipeHead % uitfPipeDepth];
+      data = ps->node->data;
+      ps->hdwords = 0;
+      ps->hdtrunc = 0;
+
+      pthread_mutex_lock(&uitfDmaLock);
+      if(hd_params.enabled)
+	{
+	  uitfDmaSelect(&hd_params.dma);
+	  ps->hdwords = hdReadBlock(data, uitfHdMaxWords, 1);
+	  ps->hdtrunc = uitfBlockTruncated(data, ps->hdwords, uitfHdMaxWords);
+	}
+
+      /* 8 byte aligned for 2eSST */
+      ps->faoffset = ((ps->hdwords > 0) ? ps->hdwords + 1 : 0) & ~1;
+      uitfDmaSelect(&uitfFa->dma);
+      ps->fawords = faReadBlock(slot, data + ps->faoffset, MAXFADCWORDS, 1);
+      ps->faerror = faGetBlockError(1);
+      ps->fatrunc = uitfBlockTruncated(data + ps->faoffset, ps->fawords, MAXFADCWORDS);
+
+      /* The rest of a block cut short is still in the module.  Dropped
+	 now, so the next slot starts with the next block */
+      if(uitfSyncScratch != NULL)
+	{
+	  if(ps->hdtrunc)
+	    {
+	      uitfDmaSelect(&hd_params.dma);
+	      hdReadBlock(uitfSyncScratch->data, uitfSyncScratchWords, 1);
+	    }
+	  if((ps->fawords > 0) && !uitfBlockComplete(data + ps->faoffset, ps->fawords))
+	    {
+	      uitfDmaSelect(&uitfFa->dma);
+	      faReadBlock(slot, uitfSyncScratch->data, uitfSyncScratchWords, 1);
+	    }
+	}
+      pthread_mutex_unlock(&uitfDmaLock);
+
+      __atomic_store_n(&uitfPipeHead, uitfPipeHead + 1, __ATOMIC_RELEASE);
+    }
+
+  return NULL;
+}
+
+/* Pool and ring for the pipelined readout.  Called at Download, after
+   uitfEventSizeCheck */
+static int32_t
+uitfPipeSetup()
+{
+  uint32_t islot;
+
+  uitfPipeline = 0;
+
+  if(vmePIPE)
+    {
+      dmaPFree(vmePIPE);
+      vmePIPE = 0;
+    }
+
+  if(readout_params.pipeline == 0)
+    return 0;
+
+  if(uitfFaN > 1)
+    {
+      printf("%s: WARN: pipeline reads one fadc250.  Disabled for %d.\n",
+	     __func__, uitfFaN);
+      return 0;
+    }
+
+  uitfPipeDepth = readout_params.pipeline_depth;
+  if(uitfPipeDepth == 0)
+    uitfPipeDepth = 4;
+  if(uitfPipeDepth > UITF_PIPE_MAX)
+    uitfPipeDepth = UITF_PIPE_MAX;
+
+  vmePIPE = dmaPCreate("vmePIPE", uitfEventLength, uitfPipeDepth, 0);
+  if(vmePIPE == 0)
+    {
+      daLogMsg("ERROR", "Unable to allocate %d pipeline buffers of %d bytes",
+	       uitfPipeDepth, uitfEventLength);
+      return -1;
+    }
+  dmaPReInit(vmePIPE);
+
+  for(islot = 0; islot < uitfPipeDepth; islot++)
+    {
+      uitfPipeSlot[islot].node = dmaPGetItem(vmePIPE);
+      if(uitfPipeSlot[islot].node == NULL)
+	{
+	  daLogMsg("ERROR", "Pipeline buffer %d of %d unavailable", islot, uitfPipeDepth);
+	  return -1;
+	}
+    }
+
+  uitfPipeline = 1;
+  printf("%s: Pipelined readout, %d blocks deep\n", __func__, uitfPipeDepth);
+
+  return 0;
+}
+
+static void
+uitfPipeStart()
+{
+  if(!uitfPipeline)
+    return;
+
+  uitfPipeHead = uitfPipeTail = 0;
+  uitfPipeHold = 0;
+  uitfPipeBusy = 0;
+  uitfPipeKicks = 0;
+  uitfPipeRun = 1;
+  if(pthread_create(&uitfPipeThread, NULL, uitfPipePrefetch, NULL) != 0)
+    {
+      daLogMsg("ERROR", "Unable to start the prefetch thread");
+      uitfPipeRun = 0;
+    }
+}
+
+static void
+uitfPipeStop()
+{
+  if(!uitfPipeRun)
+    return;
+
+  pthread_mutex_lock(&uitfPipeMutex);
+  uitfPipeRun = 0;
+  pthread_cond_broadcast(&uitfPipeCond);
+  pthread_mutex_unlock(&uitfPipeMutex);
+  pthread_join(uitfPipeThread, NULL);
+
+  if(uitfPipeHead != uitfPipeTail)
+    printf("%s: %d prefetched blocks not read out\n", __func__,
+	   uitfPipeHead - uitfPipeTail);
+}
+
+/* Banks from the oldest prefetched block.  Called after the TI block. */
+static void
+uitfPipeReadout(int32_t ev_num)
+{
+  uitf_pipe_slot_t *ps;
+  volatile uint32_t *data;
+
+  /* The TI has this block: an idle prefetch thread looks for it */
+  if(uitfPipeRun)
+    uitfPipeKick();
+
+  if(!uitfPipeRun || (uitfWait(&pipeWait, uitfPipeReady, 0) != 0))
+    {
+      uitfErrLog(UITF_ERR_PIPE_TIMEOUT, ev_num, 0, 0);
+      uitfRecoverRequest(uitfFa->slot, 1);
+      if(hd_params.enabled)
+	uitfRecoverRequest(hd_params.slot, 1);
+      if(hd_params.enabled)
+	{
+	  BANKOPEN(HELICITY_DECODER_BANK, BT_UI4, blockLevel);
+	  BANKCLOSE;
+	}
+      BANKOPEN(FADC250_DECODER_BANK, BT_UI4, blockLevel);
+      BANKCLOSE;
+      return;
+    }
+
+  ps = &uitfPipeSlot[uitfPipeTail % uitfPipeDepth];
+  data = ps->node->data;
+
+  if(hd_params.enabled)
+    {
+      BANKOPEN(HELICITY_DECODER_BANK, BT_UI4, blockLevel);
+      if(ps->hdwords <= 0)
+	{
+	  uitfErrLog(UITF_ERR_HD_READ, ev_num, ps->hdwords, 0);
+	  uitfRecoverRequest(hd_params.slot, 0);
+	}
+      else
+	{
+	  if(ps->hdtrunc)
+	    {
+	      uitfHdTruncated++;
+	      uitfErrLog(UITF_ERR_HD_TRUNC, ev_num, ps->hdwords, uitfHdMaxWords);
+	      uitfRecoverRequest(hd_params.slot, 0);
+	    }
+	  memcpy((void *)dma_dabufp, (void *)data, ps->hdwords << 2);
+	  dma_dabufp += ps->hdwords;
+	}
+      BANKCLOSE;
+    }
+
+  BANKOPEN(FADC250_DECODER_BANK, BT_UI4, blockLevel);
+  if(ps->faerror)
+    {
+      uitfErrLog(UITF_ERR_FA_BLOCK, ev_num, uitfFa->slot, ps->fawords);
+      uitfRecoverRequest(uitfFa->slot, 0);
+    }
+  else if(ps->fatrunc)
+    {
+      uitfFaTruncated++;
+      uitfErrLog(UITF_ERR_FA_TRUNC, ev_num, uitfFa->slot, ps->fawords);
+      uitfRecoverRequest(uitfFa->slot, 0);
+    }
+  if(ps->fawords > 0)
+    {
+      memcpy((void *)dma_dabufp, (void *)(data + ps->faoffset), ps->fawords << 2);
+      dma_dabufp += ps->fawords;
+    }
+  BANKCLOSE;
+
+  __atomic_store_n(&uitfPipeTail, uitfPipeTail + 1, __ATOMIC_RELEASE);
+  uitfPipeKick();
+}
+
+/* Drain of leftover data in SYNC events.  Every module with data is
+   read in turn, one block (up to the scratch buffer) per module per
+   round, so a module with a lot left does not hold up the others.  The
+   data goes to a scratch buffer and is dropped.  Modules with data left
+   when readout.sync_budget_us runs out are reset (TI block readout,
+   faClear, hdReset) so a stuck module cannot hold the readout thread. */
+enum
+  {
+    UITF_SYNC_TI = 1,
+    UITF_SYNC_HD = 2,
+    UITF_SYNC_FA = 3
+  };
+
+typedef struct
+{
+  uint32_t id;			/* UITF_SYNC_TI/HD/FA << 16 | slot */
+  uint32_t bready;		/* blocks ready at the SYNC event */
+  uint32_t reads;
+  uint32_t words;
+  uint32_t reset;
+  const dma_config_t *dma;
+} uitf_sync_module_t;
+
+uint32_t uitfSyncResets = 0;
+
+/* Scratch buffer for the drain.  Called at Download, after uitfEventSizeCheck */
+static int32_t
+uitfSyncSetup()
+{
+  if(vmeSYNC)
+    {
+      dmaPFree(vmeSYNC);
+      vmeSYNC = 0;
+    }
+  uitfSyncScratch = NULL;
+
+  /* Also the drop buffer of the resync and of the prefetch thread */
+  if((readout_params.sync_check == 0) && (readout_params.recovery == 0) &&
+     (readout_params.pipeline == 0))
+    return 0;
+
+  vmeSYNC = dmaPCreate("vmeSYNC", uitfEventLength, 1, 0);
+  if(vmeSYNC == 0)
+    {
+      daLogMsg("ERROR", "Unable to allocate the SYNC drain buffer (%d bytes)",
+	       uitfEventLength);
+      return -1;
+    }
+  dmaPReInit(vmeSYNC);
+
+  uitfSyncScratch = dmaPGetItem(vmeSYNC);
+  if(uitfSyncScratch == NULL)
+    {
+      daLogMsg("ERROR", "SYNC drain buffer unavailable");
+      return -1;
+    }
+  uitfSyncScratchWords = (uitfEventLength - UITF_EVENT_SLACK) >> 2;
+
+  return 0;
+}
+
+static int32_t
+uitfSyncBready(uitf_sync_module_t *m)
+{
+  switch(m->id >> 16)
+    {
+    case UITF_SYNC_TI:
+      return tiBReady();
+    case UITF_SYNC_HD:
+      return hdBReady();
+    default:
+      return faBready(m->id & 0xffff);
+    }
+}
+
+static int32_t
+uitfSyncRead(uitf_sync_module_t *m, volatile uint32_t *data, int32_t nwords)
+{
+  uitfDmaSelect(m->dma);
+
+  switch(m->id >> 16)
+    {
+    case UITF_SYNC_TI:
+      return tiReadTriggerBlock(data);
+    case UITF_SYNC_HD:
+      return hdReadBlock(data, nwords, 1);
+    default:
+      return faReadBlock(m->id & 0xffff, data, nwords, 1);
+    }
+}
+
+static void
+uitfSyncReset(uitf_sync_module_t *m)
+{
+  switch(m->id >> 16)
+    {
+    case UITF_SYNC_TI:
+      tiResetBlockReadout();
+      break;
+    case UITF_SYNC_HD:
+      /* Soft reset.  Full helicity decoder init at the next Download */
+      hdReset(0, 0);
+      uitf_config_modules_invalidate();
+      break;
+    default:
+      faClear(m->id & 0xffff);
+      break;
+    }
+  m->reset = 1;
+  uitfSyncResets++;
+}
+
+/* The modules of this run: TI, helicity decoder, fadc250s of the run type */
+static int32_t
+uitfSyncModules(uitf_sync_module_t *mod, const int32_t hd)
+{
+  int32_t nmod = 0, ifa;
+
+  memset(mod, 0, UITF_SYNC_MAXMOD * sizeof(uitf_sync_module_t));
+  mod[nmod].id = UITF_SYNC_TI << 16;
+  mod[nmod++].dma = &ti_params.dma;
+  if(hd)
+    {
+      mod[nmod].id = (UITF_SYNC_HD << 16) | hd_params.slot;
+      mod[nmod++].dma = &hd_params.dma;
+    }
+  for(ifa = 0; ifa < uitfFaN; ifa++)
+    {
+      fadc_config_t *fa = &fadc_params[uitfFaIndex[ifa]];
+      mod[nmod].id = (UITF_SYNC_FA << 16) | fa->slot;
+      mod[nmod++].dma = &fa->dma;
+    }
+
+  return nmod;
+}
+
+/* Blocks ready in each module.  Returns the number of modules with data */
+static int32_t
+uitfSyncPending(uitf_sync_module_t *mod, int32_t *pending, int32_t nmod)
+{
+  int32_t imod, nleft = 0, bready;
+
+  for(imod = 0; imod < nmod; imod++)
+    {
+      bready = uitfSyncBready(&mod[imod]);
+      mod[imod].bready += (bready > 0) ? bready : 0;
+      pending[imod] = (bready > 0);
+      nleft += pending[imod];
+    }
+
+  return nleft;
+}
+
+/* Round-robin reads of the pending modules into the scratch buffer,
+   until they are empty or the deadline.  Returns the modules left with data */
+static int32_t
+uitfSyncRoundRobin(uitf_sync_module_t *mod, int32_t *pending, int32_t nmod,
+		   int32_t nleft, uint64_t deadline)
+{
+  volatile uint32_t *scratch;
+  int32_t imod, dCnt;
+
+  if(uitfSyncScratch == NULL)
+    return nleft;
+  scratch = uitfSyncScratch->data;
+
+  while(nleft && (uitfNow() < deadline))
+    {
+      nleft = 0;
+      for(imod = 0; imod < nmod; imod++)
+	{
+	  uitf_sync_module_t *m = &mod[imod];
+
+	  if(!pending[imod])
+	    continue;
+
+	  dCnt = uitfSyncRead(m, scratch, uitfSyncScratchWords);
+	  m->reads++;
+	  if(dCnt > 0)
+	    m->words += dCnt;
+
+	  pending[imod] = (uitfSyncBready(m) > 0);
+	  nleft += pending[imod];
+	}
+    }
+
+  return nleft;
+}
+
+/* Returns the number of modules that had leftover data */
+static int32_t
+uitfSyncDrain(int32_t ev_num, const int32_t hd)
+{
+  uitf_sync_module_t mod[UITF_SYNC_MAXMOD];
+  int32_t pending[UITF_SYNC_MAXMOD];
+  int32_t imod, nmod, nleft, ndata;
+  uint64_t start = uitfNow();
+
+  nmod = uitfSyncModules(mod, hd);
+  ndata = nleft = uitfSyncPending(mod, pending, nmod);
+  if(nleft == 0)
+    return 0;
+
+  nleft = uitfSyncRoundRobin(mod, pending, nmod, nleft,
+			     start + readout_params.sync_budget_us * 1000ULL);
+
+  for(imod = 0; imod < nmod; imod++)
+    {
+      uitf_sync_module_t *m = &mod[imod];
+
+      if(m->bready == 0)
+	continue;
+
+      switch(m->id >> 16)
+	{
+	case UITF_SYNC_TI:
+	  uitfErrLog(UITF_ERR_SYNC_TI, ev_num, m->bready, 0);
+	  break;
+	case UITF_SYNC_HD:
+	  uitfErrLog(UITF_ERR_SYNC_HD, ev_num, m->bready, 0);
+	  break;
+	default:
+	  uitfErrLog(UITF_ERR_SYNC_FA, ev_num, m->bready, m->id & 0xffff);
+	  break;
+	}
+
+      if(pending[imod])
+	{
+	  uitfSyncReset(m);
+	  uitfErrLog(UITF_ERR_SYNC_RESET, ev_num, m->id, m->words);
+	}
+    }
+
+  /* Diagnostics bank
+       word 0: version << 24 | nmodule << 8 | budget exceeded
+       word 1: drain time (us)
+       per module: id, blocks ready, reads, words dropped, reset */
+  BANKOPEN(UITF_SYNC_BANK, BT_UI4, blockLevel);
+  *dma_dabufp++ = (UITF_SYNC_VERSION << 24) | (nmod << 8) | (nleft ? 1 : 0);
+  *dma_dabufp++ = (uitfNow() - start) / 1000;
+  for(imod = 0; imod < nmod; imod++)
+    {
+      *dma_dabufp++ = mod[imod].id;
+      *dma_dabufp++ = mod[imod].bready;
+      *dma_dabufp++ = mod[imod].reads;
+      *dma_dabufp++ = mod[imod].words;
+      *dma_dabufp++ = mod[imod].reset;
+    }
+  BANKCLOSE;
+
+  return ndata;
+}
+
+/* Hold the prefetch thread.  With drop, what it has read ahead is dropped */
+static void
+uitfPipePause(int32_t ev_num, int32_t drop)
+{
+  int32_t davail;
+
+  /* The thread stops at once if it is waiting on the modules, or after
+     the DMA of the block it is reading */
+  pthread_mutex_lock(&uitfPipeMutex);
+  uitfPipeHold = 1;
+  while(uitfPipeBusy)
+    pthread_cond_wait(&uitfPipeCond, &uitfPipeMutex);
+  pthread_mutex_unlock(&uitfPipeMutex);
+
+  davail = __atomic_load_n(&uitfPipeHead, __ATOMIC_ACQUIRE) - uitfPipeTail;
+  if(drop && (davail > 0))
+    {
+      uitfErrLog(UITF_ERR_SYNC_PIPE, ev_num, davail, 0);
+      __atomic_store_n(&uitfPipeTail, uitfPipeHead, __ATOMIC_RELEASE);
+    }
+}
+
+static void
+uitfPipeResume()
+{
+  pthread_mutex_lock(&uitfPipeMutex);
+  uitfPipeHold = 0;
+  pthread_cond_broadcast(&uitfPipeCond);
+  pthread_mutex_unlock(&uitfPipeMutex);
+}
+
+/* Resync after a block error or a ready timeout (readout.recovery).
+   rocTrigger sets a module's slot bit in uitfRecoverMask, and in
+   uitfRecoverUnread if the module may still hold this block (a timeout,
+   a failed read, the rest of a block cut short).  At the end of that
+   block, with triggers off at the TI, that block is read from each such
+   module and dropped: the late block of a timeout, or the rest of a bad
+   one.  Its event number must be one of this block's, from the TI.  A
+   later one means the module missed this block.  The pipeline drops a
+   late block from its ring instead, if the prefetch thread has read it.
+   Triggers back on.
+   The TI and the other modules are not touched, and nothing is reset,
+   so every module keeps its event counter.  Only a module that cannot
+   be read is cleared (faClear, hdReset).  In the next block, the first
+   event number of each recovered module is checked against the TI's
+   (uitfRecoverCheck).  A marker bank is written with each resync and
+   each check.  At most readout.recovery_max resyncs are done per run,
+   each within readout.recovery_budget_ms. */
+
+enum
+  {
+    UITF_RECOVER_OK = 0,
+    UITF_RECOVER_MISSING = 1,	/* a module missed this block */
+    UITF_RECOVER_CLEARED = 2,	/* a module could not be read, and was cleared */
+    UITF_RECOVER_MAX = 3,	/* recovery_max reached, not attempted */
+    UITF_RECOVER_MISMATCH = 4	/* event number != TI's, in the next block */
+  };
+
+uint32_t uitfRecoverCount = 0, uitfRecoverFailed = 0;
+uint32_t uitfRecoverVerify = 0;	/* slot bits to check in the next block */
+
+/* First event number (22 bits) of this block, from the TI trigger bank
+   (0xFF1x): length, header, then the first event's header and number.
+   Returns 0 if there is no TI bank */
+static int32_t
+uitfTiFirstEvent(uint32_t *evnum)
+{
+  volatile uint32_t *ti = uitfBlockStart;
+
+  if((ti == NULL) || ((dma_dabufp - ti) < 4) || ((ti[1] >> 20) != 0xFF1))
+    return 0;
+
+  *evnum = ti[3] & 0x3fffff;
+  return 1;
+}
+
+/* First event number (22 bits) in module data.  Returns 0 if none */
+static int32_t
+uitfFirstEvent(volatile uint32_t *data, int32_t nwords, uint32_t *evnum)
+{
+  int32_t iw;
+
+  for(iw = 0; iw < nwords; iw++)
+    if((data[iw] & 0xf8000000) == 0x90000000)
+      {
+	*evnum = data[iw] & 0x3fffff;
+	return 1;
+      }
+
+  return 0;
+}
+
+/* Marker
+     word 0: version << 24 | check << 20 | status << 16 | resyncs this run
+     word 1: slot mask of the modules recovered (resync) or checked
+     word 2: TI block number
+   resync (check = 0)
+     word 3: time (us) with triggers off
+     word 4: words dropped
+     word 5: blocks dropped
+   check (check = 1)
+     word 3: TI event number
+     word 4: slot of the first module out of step (0: none)
+     word 5: its event number */
+static void
+uitfRecoverMarker(int32_t check, int32_t status, uint32_t mask, int32_t ev_num,
+		  uint32_t w3, uint32_t w4, uint32_t w5)
+{
+  BANKOPEN(UITF_RECOVER_BANK, BT_UI4, blockLevel);
+  *dma_dabufp++ = (UITF_RECOVER_VERSION << 24) | (check << 20) | (status << 16) |
+    (uitfRecoverCount & 0xffff);
+  *dma_dabufp++ = mask;
+  *dma_dabufp++ = ev_num;
+  *dma_dabufp++ = w3;
+  *dma_dabufp++ = w4;
+  *dma_dabufp++ = w5;
+  BANKCLOSE;
+}
+
+static void
+uitfRecover(int32_t ev_num, const int32_t hd)
+{
+  uitf_sync_module_t mod[UITF_SYNC_MAXMOD];
+  int32_t imod, nmod, dCnt, status = UITF_RECOVER_OK, valid;
+  uint32_t mask = uitfRecoverMask, unread = uitfRecoverUnread;
+  uint32_t words = 0, blocks = 0, first = 0, evnum, bit;
+  uint64_t start = uitfNow(), deadline;
+
+  uitfRecoverMask = uitfRecoverUnread = 0;
+  deadline = start + readout_params.recovery_budget_ms * 1000000ULL;
+
+  if(uitfRecoverCount >= readout_params.recovery_max)
+    {
+      status = UITF_RECOVER_MAX;
+      uitfErrLog(UITF_ERR_RECOVER, ev_num, mask, status);
+      return;
+    }
+  uitfRecoverCount++;
+
+  if(uitfPipeline)
+    uitfPipePause(ev_num, 0);
+
+  /* No new triggers.  The blocks the TI has already accepted stay */
+  tiDisableTriggerSource(0);
+
+  valid = uitfTiFirstEvent(&first);
+
+  /* Pipeline: this block, read late by the prefetch thread, is the
+     oldest in the ring.  It holds both modules */
+  if(uitfPipeline && (unread & (1u << (uitfFa->slot & 0x1f))) &&
+     (__atomic_load_n(&uitfPipeHead, __ATOMIC_ACQUIRE) != uitfPipeTail))
+    {
+      uitf_pipe_slot_t *ps = &uitfPipeSlot[uitfPipeTail % uitfPipeDepth];
+
+      if((ps->fawords > 0) &&
+	 uitfFirstEvent(ps->node->data + ps->faoffset, ps->fawords, &evnum) &&
+	 (!valid || (((evnum - first) & 0x3fffff) < (uint32_t)blockLevel)))
+	{
+	  words += ps->fawords + ((ps->hdwords > 0) ? ps->hdwords : 0);
+	  blocks++;
+	  __atomic_store_n(&uitfPipeTail, uitfPipeTail + 1, __ATOMIC_RELEASE);
+	  unread = 0;
+	}
+    }
+
+  /* This block, from each affected module that may still hold it */
+  nmod = uitfSyncModules(mod, hd);
+  for(imod = 0; imod < nmod; imod++)
+    {
+      uitf_sync_module_t *m = &mod[imod];
+
+      bit = 1u << ((m->id & 0xffff) & 0x1f);
+      if(((m->id >> 16) == UITF_SYNC_TI) || !(unread & bit) ||
+	 (uitfSyncScratch == NULL))
+	continue;
+
+      while((uitfSyncBready(m) <= 0) && (uitfNow() < deadline))
+	UITF_CPU_RELAX();
+      if(uitfSyncBready(m) <= 0)
+	{
+	  if(status == UITF_RECOVER_OK)
+	    status = UITF_RECOVER_MISSING;
+	  continue;
+	}
+
+      dCnt = uitfSyncRead(m, uitfSyncScratch->data, uitfSyncScratchWords);
+      m->reads++;
+      if(dCnt <= 0)
+	{
+	  /* Cannot be read.  Cleared, which loses its event counter */
+	  uitfSyncReset(m);
+	  if((m->id >> 16) == UITF_SYNC_HD)
+	    hdEnable();
+	  status = UITF_RECOVER_CLEARED;
+	  continue;
+	}
+      words += dCnt;
+      blocks++;
+
+      /* A block of a later event: this one never came */
+      if(valid && uitfFirstEvent(uitfSyncScratch->data, dCnt, &evnum) &&
+	 (((evnum - first) & 0x3fffff) >= (uint32_t)blockLevel) &&
+	 (status == UITF_RECOVER_OK))
+	status = UITF_RECOVER_MISSING;
+    }
+
+  tiEnableTriggerSource();
+
+  if(uitfPipeline)
+    uitfPipeResume();
+
+  if(status != UITF_RECOVER_OK)
+    uitfRecoverFailed++;
+  else
+    uitfRecoverVerify |= mask;
+  uitfErrLog(UITF_ERR_RECOVER, ev_num, mask, status);
+
+  uitfRecoverMarker(0, status, mask, ev_num, (uitfNow() - start) / 1000, words, blocks);
+}
+
+/* Format a snapshot.  Runs on the status thread: no module access */
+static void
+uitfStatusDump(const uitf_status_snapshot_t *snap)
+{
+  const uitf_status_fadc_t *fa;
+  int32_t ifa, ich;
+
+  UITF_DALMAGO;
+  printf("%s: %s (run %d)\n", __func__, snap->transition, snap->run_number);
+  printf("  TI:  blocks %u  ready %d  blocklevel %d  bufferlevel %d  sync %d\n",
+	 snap->ti_intcount, snap->ti_bready, snap->ti_blocklevel,
+	 snap->ti_bufferlevel, snap->ti_syncflag);
+  if(snap->hd_enabled)
+    printf("  HD:  ready %d\n", snap->hd_bready);
+  for(ifa = 0; ifa < snap->nfa; ifa++)
+    {
+      fa = &snap->fa[ifa];
+      printf("  FADC slot %2d (%s):  ready %d\n", fa->slot,
+	     (fa->type == UITF_INTEGRATING) ? "integrating" : "counting", fa->bready);
+      printf("    DAC      ");
+      for(ich = 0; ich < UITF_STATUS_NCHAN; ich++)
+	printf(" %4d", fa->dac[ich]);
+      printf("\n    Threshold");
+      for(ich = 0; ich < UITF_STATUS_NCHAN; ich++)
+	printf(" %4d", fa->threshold[ich]);
+      printf("\n");
+    }
+  UITF_DALMASTOP;
+}
+
+/* Module registers, read in one pass on the transition thread, for the
+   status thread to format (readout.async_status).  Without async_status
+   the library status dumps run here, as before */
+static void
+uitfStatusSnapshot(const char *transition)
+{
+  uitf_status_snapshot_t snap;
+  uitf_status_fadc_t *fa;
+  int32_t ifa, ich;
+
+  if(!readout_params.async_status)
+    {
+      UITF_DALMAGO;
+      tiStatus(0);
+      faSDC_Status(0);
+      faSDC_Status_Integrating(0);
+      faGStatus(0);
+      if(hd_params.enabled)
+	hdStatus(0);
+      UITF_DALMASTOP;
+      return;
+    }
 
-/* TI VME address (Slot 3) */
-#define TI_ADDR  (3 << 19)
+  memset(&snap, 0, sizeof(snap));
+  snap.transition = transition;
+  snap.run_number = rol->runNumber;
+  snap.time_ns = uitfNow();
+  snap.ti_intcount = tiGetIntCount();
+  snap.ti_bready = tiBReady();
+  snap.ti_blocklevel = tiGetCurrentBlockLevel();
+  snap.ti_bufferlevel = tiGetBlockBufferLevel();
+  snap.ti_syncflag = tiGetSyncEventFlag();
+  if(hd_params.enabled)
+    {
+      snap.hd_enabled = 1;
+      snap.hd_bready = hdBReady();
+    }
 
-#define FIBER_LATENCY_OFFSET 0x10
+  /* Every board in the config, not only those read out */
+  for(ifa = 0; (ifa < uitf_nfadc) && (ifa < UITF_STATUS_MAXFA); ifa++)
+    {
+      fa = &snap.fa[ifa];
+      fa->slot = fadc_params[ifa].slot;
+      fa->type = fadc_params[ifa].type;
+      fa->bready = faBready(fa->slot);
+      for(ich = 0; ich < UITF_STATUS_NCHAN; ich++)
+	{
+	  fa->dac[ich] = faGetChannelDAC(fa->slot, ich);
+	  fa->threshold[ich] = faGetChThreshold(fa->slot, ich);
+	}
+    }
+  snap.nfa = ifa;
 
- /* Source required for CODA readout lists using the TI */
-#include "dmaBankTools.h"
-#include "tiprimary_list.c"
+  uitfStatusRequest(&snap);
+}
 
-/* Library to pipe stdout to daLogMsg */
-#include "dalmaRolLib.h"
+/* fadc250s of the run type, from the config */
+static int32_t
+uitfFadcSelect()
+{
+  int32_t ifa;
 
-/* Event type 137 code */
-#include "rocUtils.c"
+  uitfFaN = 0;
+  for(ifa = 0; ifa < uitf_nfadc; ifa++)
+    if(fadc_params[ifa].type == (uint32_t)UITF_RUN_TYPE)
+      uitfFaIndex[uitfFaN++] = ifa;
 
-/* uitf config library */
-#include "uitf_config.c"
+  if(uitfFaN == 0)
+    {
+      daLogMsg("ERROR", "No %s fadc250 in the config",
+	       (UITF_RUN_TYPE == UITF_COUNTING) ? "counting" : "integrating");
+      return -1;
+    }
+  uitfFa = &fadc_params[uitfFaIndex[0]];
 
-/* fadc library*/
-#include "fadcLib.h"
-int32_t MAXFADCWORDS = 0;
-const uint32_t FADC250_DECODER_BANK = 0X0250;
+  printf("%s: %d fadc250 read out, slot", __func__, uitfFaN);
+  for(ifa = 0; ifa < uitfFaN; ifa++)
+    printf(" %d", fadc_params[uitfFaIndex[ifa]].slot);
+  printf("\n");
 
-/* helicity decoder library */
-#include "hdLib.h"
-const uint32_t HELICITY_DECODER_BANK = 0xDEC;
+  return 0;
+}
 
-// runtype set by user string at Download.  default to counting
-int32_t UITF_RUN_TYPE = UITF_COUNTING;
+/* Largest block ready deadline (ns) of the fadc250s read out, and of the
+   helicity decoder if with_hd.  0 (default) counts as UITF_WAIT_DEFAULT_NS */
+static uint64_t
+uitfReadyTimeout(int32_t with_hd)
+{
+  uint64_t ns, maxns = 0;
+  int32_t ifa;
+
+  for(ifa = 0; ifa < uitfFaN; ifa++)
+    {
+      ns = fadc_params[uitfFaIndex[ifa]].ready_timeout_ns;
+      if(ns == 0)
+	ns = UITF_WAIT_DEFAULT_NS;
+      if(ns > maxns)
+	maxns = ns;
+    }
+
+  if(with_hd && hd_params.enabled)
+    {
+      ns = hd_params.ready_timeout_ns;
+      if(ns == 0)
+	ns = UITF_WAIT_DEFAULT_NS;
+      if(ns > maxns)
+	maxns = ns;
+    }
+
+  return maxns;
+}
+
+/* Helicity-correlated sums of the integrating fadc250s (readout.asym) */
+static int32_t
+uitfAsymSetup()
+{
+  uint32_t slots[UITF_FADC_MAX], pattern;
+  int32_t ifa;
+
+  uitfAsym = 0;
+  if(!readout_params.asym)
+    return 0;
+
+  if(!hd_params.enabled || (UITF_RUN_TYPE != UITF_INTEGRATING))
+    {
+      daLogMsg("WARN",
+	       "asym needs the helicity decoder and the integrating run type. Disabled.");
+      return 0;
+    }
+
+  /* The sums are of the pulse integral (type 7) words */
+  for(ifa = 0; ifa < uitfFaN; ifa++)
+    {
+      fadc_config_t *fa = &fadc_params[uitfFaIndex[ifa]];
+
+      if((fa->mode != 3) && (fa->mode != 7))
+	{
+	  daLogMsg("ERROR",
+		   "asym needs pulse integrals (fadc250 mode 3 or 7).  Slot %d is mode %d",
+		   fa->slot, fa->mode);
+	  return -1;
+	}
+      slots[ifa] = fa->slot;
+    }
+
+  /* The internal helicity pattern is only that of the beam with the
+     internal helicity generator */
+  if(readout_params.asym_pattern == UITF_ASYM_PATTERN_INTERNAL)
+    {
+      if(!hd_params.use_internal_helicity)
+	{
+	  daLogMsg("ERROR",
+		   "asym_pattern \"internal\" needs use_internal_helicity.  Set the pattern of the helicity signals");
+	  return -1;
+	}
+      pattern = hd_params.internal.helicity_pattern;
+    }
+  else
+    pattern = readout_params.asym_pattern - 1;
+
+  if(uitfAsymInit(pattern, slots, uitfFaN) != 0)
+    {
+      daLogMsg("ERROR", "Helicity asymmetry setup failed");
+      return -1;
+    }
+  uitfAsym = 1;
+
+  return 0;
+}
+
+/* Contents of the first bank with this tag in the block being built */
+static volatile uint32_t *
+uitfBankFind(uint32_t tag, int32_t *nwords)
+{
+  volatile uint32_t *bank = uitfBlockStart;
+
+  while((bank + 1) < dma_dabufp)
+    {
+      if((bank[1] >> 16) == tag)
+	{
+	  *nwords = bank[0] - 1;
+	  return bank + 2;
+	}
+      bank += bank[0] + 1;
+    }
+
+  return NULL;
+}
+
+/* First event number (22 bits) of each slot in mask, in a bank of
+   module blocks.  Returns the slots found */
+static uint32_t
+uitfRecoverEvents(uint32_t tag, uint32_t mask, uint32_t *evnum)
+{
+  volatile uint32_t *bank;
+  int32_t nwords = 0, iw, slot = -1;
+  uint32_t found = 0;
+
+  bank = uitfBankFind(tag, &nwords);
+  if(bank == NULL)
+    return 0;
+
+  for(iw = 0; iw < nwords; iw++)
+    {
+      uint32_t w = bank[iw];
+
+      if((w & 0xf8000000) == 0x80000000)	/* block header */
+	slot = (w >> 22) & 0x1f;
+      else if(((w & 0xf8000000) == 0x90000000) && (slot >= 0) &&	/* event header */
+	      (mask & ~found & (1u << slot)))
+	{
+	  evnum[slot] = w & 0x3fffff;
+	  found |= (1u << slot);
+	}
+    }
+
+  return found;
+}
+
+/* Event numbers of the modules recovered in the last block, against the
+   TI's.  Called after the module readout */
+static void
+uitfRecoverCheck(int32_t ev_num)
+{
+  uint32_t mask = uitfRecoverVerify, found = 0, tiev = 0, slot, bad = 0;
+  uint32_t evnum[32];
+  int32_t status = UITF_RECOVER_OK;
+
+  uitfRecoverVerify = 0;
+
+  if(uitfTiFirstEvent(&tiev))
+    {
+      found |= uitfRecoverEvents(HELICITY_DECODER_BANK, mask, evnum);
+      found |= uitfRecoverEvents(FADC250_DECODER_BANK, mask, evnum);
+    }
+
+  for(slot = 0; slot < 32; slot++)
+    if((mask & (1u << slot)) &&
+       (!(found & (1u << slot)) || (evnum[slot] != tiev)))
+      {
+	status = UITF_RECOVER_MISMATCH;
+	bad = slot;
+	break;
+      }
+
+  if(status != UITF_RECOVER_OK)
+    uitfRecoverFailed++;
+  uitfErrLog(UITF_ERR_RECOVER, ev_num, mask, status);
+
+  uitfRecoverMarker(1, status, mask, ev_num, tiev, bad,
+		    (found & (1u << bad)) ? evnum[bad] : 0);
+}
+
+/* Add the HD and fadc250 banks of this block to the helicity sums */
+static void
+uitfAsymReadout()
+{
+  volatile uint32_t *hdbank, *fabank;
+  int32_t hdwords = 0, fawords = 0;
+
+  hdbank = uitfBankFind(HELICITY_DECODER_BANK, &hdwords);
+  fabank = uitfBankFind(FADC250_DECODER_BANK, &fawords);
+  if(hdbank && fabank)
+    uitfAsymBlock(hdbank, hdwords, fabank, fawords);
+}
+
+/* Raw window reduction of the fadc250s read (readout.pulse).  Each raw
+   window becomes at most 1 + 2 x np words */
+static int32_t
+uitfPulseSetup()
+{
+  uitf_pulse_board_t boards[UITF_FADC_MAX];
+  int32_t ifa, nraw = 0, fawords;
+
+  uitfPulse = 0;
+  uitfPulseWords = 0;
+  if(uitfPulseBuf)
+    {
+      free((void *)uitfPulseBuf);
+      uitfPulseBuf = NULL;
+    }
+  if(!readout_params.pulse)
+    return 0;
+
+  for(ifa = 0; ifa < uitfFaN; ifa++)
+    {
+      fadc_config_t *fa = &fadc_params[uitfFaIndex[ifa]];
+      uitf_pulse_board_t *b = &boards[ifa];
+      int32_t ich;
+
+      /* raw window, raw window + time, raw window + pulse parameter */
+      if((fa->mode == 1) || (fa->mode == 8) || (fa->mode == 10))
+	nraw++;
+
+      b->slot = fa->slot;
+      b->nsb = fa->nsb;
+      b->nsa = fa->nsa;
+      b->np = fa->np;
+      b->firmware = (fa->mode == 10);
+      for(ich = 0; ich < UITF_PULSE_NCHAN; ich++)
+	b->threshold[ich] = fa->threshold[ich];
+
+      fawords = uitf_config_fadc_block_words(fa, ti_params.blocklevel, NULL);
+      if(fawords <= 0)
+	return -1;
+      uitfPulseWords += fawords +
+	ti_params.blocklevel * UITF_PULSE_NCHAN * (1 + 2 * UITF_PULSE_MAXNP);
+    }
+
+  if(nraw == 0)
+    {
+      daLogMsg("WARN", "pulse needs a fadc250 in a raw window mode (1, 8, 10). Disabled.");
+      return 0;
+    }
+
+  if(uitfPulseInit(boards, uitfFaN) != 0)
+    {
+      daLogMsg("ERROR", "fadc250 pulse engine setup failed");
+      return -1;
+    }
+
+  uitfPulseBuf = (volatile uint32_t *)malloc(uitfPulseWords << 2);
+  if(uitfPulseBuf == NULL)
+    {
+      daLogMsg("ERROR", "Unable to allocate %d words for the pulse bank", uitfPulseWords);
+      return -1;
+    }
+  uitfPulse = 1;
+
+  printf("%s: Raw windows reduced to pulses.  Raw kept every %d blocks\n",
+	 __func__, readout_params.pulse_raw_prescale);
+
+  return 0;
+}
+
+/* Replace the fadc250 bank of this block with the pulse bank.  The raw
+   bank stays (before the pulse bank) every readout.pulse_raw_prescale
+   blocks, or if it is not the last bank */
+static void
+uitfPulseReadout(int32_t ev_num)
+{
+  volatile uint32_t *fabank;
+  int32_t fawords = 0, nwords, keepraw;
+
+  fabank = uitfBankFind(FADC250_DECODER_BANK, &fawords);
+  if(fabank == NULL)
+    return;
+
+  nwords = uitfPulseBlock(fabank, fawords, uitfPulseBuf, uitfPulseWords);
+  if(nwords < 0)
+    {
+      uitfErrLog(UITF_ERR_PULSE, ev_num, fawords, 0);
+      return;
+    }
+
+  uitfPulseBlocks++;
+  keepraw = readout_params.pulse_raw_prescale &&
+    ((uitfPulseBlocks % readout_params.pulse_raw_prescale) == 0);
+  if(!keepraw && ((fabank + fawords) == dma_dabufp))
+    dma_dabufp = fabank - 2;
+
+  BANKOPEN(UITF_PULSE_BANK, BT_UI4, blockLevel);
+  memcpy((void *)dma_dabufp, (void *)uitfPulseBuf, nwords << 2);
+  dma_dabufp += nwords;
+  BANKCLOSE;
+}
+
+/* rocTrigger variant for this run.  With the trigger routines, below */
+static int32_t uitfTriggerSelect();
 
 /****************************************
  *  DOWNLOAD
@@ -59,6 +1839,9 @@ rocDownload()
 {
   int stat;
 
+  /* Finish any dumps from the previous run before reprogramming */
+  uitfStatusFlush();
+
   if(strlen(rol->usrString) > 0)
     {
       if(strcasecmp(rol->usrString, "integrating") == 0)
@@ -76,6 +1859,18 @@ rocDownload()
       return;
     }
 
+  if(uitfFadcSelect() != 0)
+    return;
+
+  if(uitfReadoutModeSelect() != 0)
+    return;
+
+  if(uitfAsymSetup() != 0)
+    return;
+
+  if(uitfPulseSetup() != 0)
+    return;
+
   if(uitf_config_modules_init() != 0)
     {
       daLogMsg("ERROR", "Module init error");
@@ -83,6 +1878,47 @@ rocDownload()
     }
 
   blockLevel = ti_params.blocklevel;
+
+  if(uitfEventSizeCheck() != 0)
+    return;
+
+  if(uitfEventPoolCreate() != 0)
+    return;
+
+  if(uitfPipeSetup() != 0)
+    return;
+
+  if(uitfSyncSetup() != 0)
+    return;
+
+  uitfWaitInit(&hdWait, "HD", hd_params.ready_timeout_ns);
+  /* One wait per stage, so with the longest deadline of its boards */
+  uitfWaitInit(&faWait, "FADC", uitfReadyTimeout(0));
+  uitfWaitInit(&chainWait, "HD+FADC", uitfReadyTimeout(1));
+
+  uitfWaitInit(&pipeWait, "PIPE", uitfReadyTimeout(1));
+  uitfWaitInit(&prefetchWait, "PREFETCH", uitfReadyTimeout(1));
+
+  uitfChainSetup();
+
+  if(uitfTriggerSelect() != 0)
+    return;
+
+  uitfStatusInit(uitfStatusDump, readout_params.async_status);
+
+  if(uitfErrLogInit(uitfErrClass, UITF_ERR_NCLASS) != 0)
+    {
+      daLogMsg("ERROR", "Error log init error");
+      return;
+    }
+  uitfErrLogSetPrintLock(&uitfPrintMutex);
+
+  if(uitfPerfInit(uitfPerfName, UITF_PERF_NSTAGE) != 0)
+    {
+      daLogMsg("ERROR", "Stage timing init error");
+      return;
+    }
+
   /*
    * Set Trigger source
    *    For the TI-Master, valid sources:
@@ -101,12 +1937,7 @@ rocDownload()
       tiSetTriggerSource(TI_TRIGGER_FPTRG);
     }
 
-  tiStatus(0);
-  faSDC_Status(0);
-  faSDC_Status_Integrating(0);
-  faGStatus(0);
-  if(hd_params.enabled)
-    hdStatus(0);
+  uitfStatusSnapshot("Download");
 
   printf("rocDownload: User Download Executed\n");
 
@@ -121,14 +1952,7 @@ rocPrestart()
 
   /* Program modules */
 
-  DALMAGO;
-  tiStatus(0);
-  faSDC_Status(0);
-  faSDC_Status_Integrating(0);
-  faGStatus(0);
-  if(hd_params.enabled)
-    hdStatus(0);
-  DALMASTOP;
+  uitfStatusSnapshot("Prestart");
 
   if(rol->usrConfig)
     {
@@ -156,24 +1980,44 @@ rocPrestart()
 void
 rocGo()
 {
+  int32_t ifa;
 
   /* Print out the Run Number and Run Type (config id) */
   printf("rocGo: Activating Run Number %d, Config id = %d\n",
 	 rol->runNumber,rol->runType);
 
-  DALMAGO;
-  tiStatus(0);
-  faSDC_Status(0);
-  faSDC_Status_Integrating(0);
-  faGStatus(0);
-  if(hd_params.enabled)
-    hdStatus(0);
-  DALMASTOP;
-
+  uitfWaitReset(&hdWait);
+  uitfWaitReset(&faWait);
+  uitfWaitReset(&chainWait);
+  uitfWaitReset(&pipeWait);
+  uitfWaitReset(&prefetchWait);
+  uitfChainErrors = 0;
+  uitfSyncResets = 0;
+  uitfRecoverMask = uitfRecoverUnread = uitfRecoverVerify = 0;
+  uitfRecoverCount = 0;
+  uitfRecoverFailed = 0;
+  uitfHdTruncated = 0;
+  uitfFaTruncated = 0;
+  uitfDmaValid = 0;
+  uitfDmaNconfig = 0;
+  uitfDmaSelect(&ti_params.dma);
+  uitfGoTime = uitfNow();
+  uitfErrLogReset();
+  uitfPerfReset();
+  if(uitfAsym)
+    uitfAsymReset();
+  if(uitfPulse)
+    uitfPulseReset();
+  uitfPulseBlocks = 0;
+
+  /* Library prints while enabling stay out of a Prestart dump still
+     being captured */
+  pthread_mutex_lock(&uitfPrintMutex);
   if(UITF_RUN_TYPE == UITF_COUNTING)
     {
       /* Enable syncreset source */
-      faEnableSyncSrc(fadc_params[UITF_COUNTING].slot);
+      for(ifa = 0; ifa < uitfFaN; ifa++)
+	faEnableSyncSrc(fadc_params[uitfFaIndex[ifa]].slot);
 
       /* Sync Reset to init fadc250 timestamp and internal buffers */
       faSDC_Sync();
@@ -183,19 +2027,27 @@ rocGo()
       if(hd_params.enabled)
 	  hdEnable();
 
-      faEnable(fadc_params[UITF_COUNTING].slot, 0, 0);
+      for(ifa = 0; ifa < uitfFaN; ifa++)
+	faEnable(fadc_params[uitfFaIndex[ifa]].slot, 0, 0);
     }
   else if(UITF_RUN_TYPE == UITF_INTEGRATING)
     {
-      faEnableSyncSrc(fadc_params[UITF_INTEGRATING].slot);
+      for(ifa = 0; ifa < uitfFaN; ifa++)
+	faEnableSyncSrc(fadc_params[uitfFaIndex[ifa]].slot);
       faSDC_Sync_Integrating();
       taskDelay(1);
 
       tiIntEnable(1);
 
       taskDelay(1);
-      faEnable(fadc_params[UITF_INTEGRATING].slot, 0, 0);
+      for(ifa = 0; ifa < uitfFaN; ifa++)
+	faEnable(fadc_params[uitfFaIndex[ifa]].slot, 0, 0);
     }
+  pthread_mutex_unlock(&uitfPrintMutex);
+
+  uitfStatusSnapshot("Go");
+
+  uitfPipeStart();
 
 }
 
@@ -205,173 +2057,350 @@ rocGo()
 void
 rocEnd()
 {
+  uitfPipeStop();
+
   faGDisable(0);
 
   if(hd_params.enabled)
     hdDisable();
 
-  DALMAGO;
-  tiStatus(0);
-  faSDC_Status(0);
-  faSDC_Status_Integrating(0);
-  faGStatus(0);
+  uitfErrLogFlush();
+
+  UITF_DALMAGO;
+  uitfErrLogPrint();
+  uitfPerfPrint();
+  if(uitfAsym)
+    uitfAsymPrint();
+  if(uitfPulse)
+    uitfPulsePrint();
+  printf("rocEnd: vmeDmaConfig writes: %d\n", uitfDmaNconfig);
+  if(uitfSyncResets)
+    printf("rocEnd: Modules reset after the SYNC drain budget: %d\n", uitfSyncResets);
+  if(uitfRecoverCount)
+    printf("rocEnd: Module resyncs: %d (%d failed)\n", uitfRecoverCount, uitfRecoverFailed);
+  if(uitfHdTruncated)
+    printf("rocEnd: Helicity Decoder blocks truncated: %d\n", uitfHdTruncated);
+  if(uitfFaTruncated)
+    printf("rocEnd: fADC250 blocks truncated: %d\n", uitfFaTruncated);
   if(hd_params.enabled)
-    hdStatus(0);
-  DALMASTOP;
+    uitfWaitPrint(&hdWait);
+  uitfWaitPrint(&faWait);
+  if(uitfPipeline)
+    {
+      uitfWaitPrint(&pipeWait);
+      uitfWaitPrint(&prefetchWait);
+    }
+  if(uitfChainedDma)
+    {
+      uitfWaitPrint(&chainWait);
+      printf("rocEnd: Chained DMA errors: %d\n", uitfChainErrors);
+    }
+  UITF_DALMASTOP;
+
+  /* After the wait statistics, so the two DALMAGO blocks do not overlap */
+  uitfStatusSnapshot("End");
+
+  if(uitfGoTime)
+    {
+      uint64_t run_ns = uitfNow() - uitfGoTime;
+      if(run_ns > 1000000000ULL)
+	uitfLastRate = (uint32_t)(((uint64_t)tiGetIntCount() * blockLevel * 1000000000ULL) / run_ns);
+      uitfGoTime = 0;
+    }
 
-  printf("rocEnd: Ended after %d blocks\n",tiGetIntCount());
+  printf("rocEnd: Ended after %d blocks (%d Hz)\n",tiGetIntCount(), uitfLastRate);
 
 }
 
 /****************************************
  *  TRIGGER
  ****************************************/
-void
-rocTrigger(int arg)
+static inline __attribute__((always_inline)) void
+uitfTriggerBody(int arg, const int32_t path, const int32_t hd, const int32_t sync)
 {
-  extern int32_t nfadc;
-  int ev_num = 0, dCnt = 0;
-  int timeout=0, maxtime = 100;
+  int ev_num = 0, dCnt = 0, modules_read = 0, ifa;
+  uint64_t tstart, t;
+
+  tstart = t = uitfPerfNow();
 
   ev_num = tiGetIntCount();
+  uitfBlockStart = dma_dabufp;
 
-  /* Setup Address and data modes for DMA transfers
-   *
-   *  vmeDmaConfig(addrType, dataType, sstMode);
-   *
-   *  addrType = 0 (A16)    1 (A24)    2 (A32)
-   *  dataType = 0 (D16)    1 (D32)    2 (BLK32) 3 (MBLK) 4 (2eVME) 5 (2eSST)
-   *  sstMode  = 0 (SST160) 1 (SST267) 2 (SST320)
-   */
-  vmeDmaConfig(2,5,1);
+  /* Address and data modes for DMA transfers.  Written at Go, and here
+     only if this module's settings differ from the last module read */
+  UITF_DMA_LOCK(path == UITF_PATH_PIPE);
+  uitfDmaSelect(&ti_params.dma);
 
   /* Readout the trigger block from the TI
      Trigger Block MUST be readout first */
   dCnt = tiReadTriggerBlock(dma_dabufp);
+  UITF_DMA_UNLOCK(path == UITF_PATH_PIPE);
 
   if(dCnt<=0)
     {
-      printf("ERROR: Event %d: No TI Trigger data or error.  dCnt = %d\n",
-	     ev_num, dCnt);
+      uitfErrLog(UITF_ERR_TI_DATA, ev_num, dCnt, 0);
     }
   else
     { /* TI Data is already in a bank structure.  Bump the pointer */
       dma_dabufp += dCnt;
     }
+  uitfPerfMark(UITF_PERF_TI_READ, &t);
 
 
-  /* Helicity Decoder readout */
-  if(hd_params.enabled)
+  /* Helicity Decoder and fADC250 from the prefetch thread, or in one
+     chained transfer, if enabled.  Otherwise (or if the chained transfer
+     was not ready in time) read one module at a time. */
+  if(path == UITF_PATH_PIPE)
     {
-      dCnt = 0;
-      BANKOPEN(HELICITY_DECODER_BANK, BT_UI4, blockLevel);
-      while((hdBReady()!=1) && (timeout<maxtime))
-	{
-	  timeout++;
-	}
+      /* Helicity Decoder and fADC250 blocks from the prefetch thread */
+      uitfPipeReadout(ev_num);
+      uitfPerfMark(UITF_PERF_PIPE, &t);
+      modules_read = 1;
+    }
+  else if(path == UITF_PATH_CHAIN)
+    {
+      modules_read = (uitfChainedReadout(ev_num) == 0);
+      uitfPerfMark(UITF_PERF_CHAIN, &t);
+    }
 
-      if(timeout>=maxtime)
+  if(!modules_read)
+    {
+      /* Helicity Decoder readout */
+      if(hd)
 	{
-	  printf("%s: ERROR: TIMEOUT waiting for Helicity Decoder Block Ready\n",
-		 __func__);
+	  dCnt = 0;
+	  BANKOPEN(HELICITY_DECODER_BANK, BT_UI4, blockLevel);
+	  if(uitfWait(&hdWait, uitfHdReady, 0) != 0)
+	    {
+	      uitfErrLog(UITF_ERR_HD_TIMEOUT, ev_num, 0, 0);
+	      uitfRecoverRequest(hd_params.slot, 1);
+	      uitfPerfMark(UITF_PERF_HD_WAIT, &t);
+	    }
+	  else
+	    {
+	      int32_t limit = uitfHdReadLimit();
+
+	      uitfPerfMark(UITF_PERF_HD_WAIT, &t);
+	      uitfDmaSelect(&hd_params.dma);
+	      dCnt = hdReadBlock(dma_dabufp, limit, 1);
+	      uitfPerfMark(UITF_PERF_HD_DMA, &t);
+	      if(dCnt<=0)
+		{
+		  uitfErrLog(UITF_ERR_HD_READ, ev_num, dCnt, 0);
+		  uitfRecoverRequest(hd_params.slot, 1);
+		}
+	      else
+		{
+		  /* The rest of the block is flushed by the resync */
+		  if(uitfBlockTruncated(dma_dabufp, dCnt, limit))
+		    {
+		      uitfHdTruncated++;
+		      uitfErrLog(UITF_ERR_HD_TRUNC, ev_num, dCnt, limit);
+		      uitfRecoverRequest(hd_params.slot, 1);
+		    }
+		  dma_dabufp += dCnt;
+		}
+	    }
+
+	  BANKCLOSE;
 	}
-      else
+
+
+      /* fADC250 Readout: the block of each board of the run type */
+      BANKOPEN(FADC250_DECODER_BANK,BT_UI4,blockLevel);
+
+      for(ifa = 0; ifa < uitfFaN; ifa++)
 	{
-	  dCnt = hdReadBlock(dma_dabufp, 1024>>2,1);
-	  if(dCnt<=0)
+	  fadc_config_t *fa = &fadc_params[uitfFaIndex[ifa]];
+
+	  if(uitfWait(&faWait, uitfFaReady, fa->slot) != 0)
 	    {
-	      printf("%s: ERROR or NO data from hdReadBlock(...) = %d\n",
-		     __func__, dCnt);
+	      uitfErrLog(UITF_ERR_FA_TIMEOUT, ev_num, fa->slot, 0);
+	      uitfRecoverRequest(fa->slot, 1);
+	      uitfPerfMark(UITF_PERF_FA_WAIT, &t);
 	    }
 	  else
 	    {
-	      dma_dabufp += dCnt;
+	      int32_t blockError = 0;
+
+	      uitfPerfMark(UITF_PERF_FA_WAIT, &t);
+	      uitfDmaSelect(&fa->dma);
+	      dCnt = faReadBlock(fa->slot, dma_dabufp, MAXFADCWORDS, 1);
+	      uitfPerfMark(UITF_PERF_FA_DMA, &t);
+
+	      blockError = faGetBlockError(1);
+	      uitfPerfMark(UITF_PERF_FA_BLKERR, &t);
+	      if(blockError)
+		{
+		  uitfErrLog(UITF_ERR_FA_BLOCK, ev_num, fa->slot, dCnt);
+		  uitfRecoverRequest(fa->slot,
+				     (dCnt <= 0) || !uitfBlockComplete(dma_dabufp, dCnt));
+
+		  if(dCnt > 0)
+		    dma_dabufp += dCnt;
+		}
+	      else
+		{
+		  /* The rest of the block is flushed by the resync */
+		  if(uitfBlockTruncated(dma_dabufp, dCnt, MAXFADCWORDS))
+		    {
+		      uitfFaTruncated++;
+		      uitfErrLog(UITF_ERR_FA_TRUNC, ev_num, fa->slot, dCnt);
+		      uitfRecoverRequest(fa->slot, 1);
+		    }
+		  dma_dabufp += dCnt;
+		}
 	    }
 	}
-
       BANKCLOSE;
     }
 
+  /* Event numbers of the modules resynced in the last block */
+  if(uitfRecoverVerify)
+    uitfRecoverCheck(ev_num);
 
-  /* fADC250 Readout */
-  BANKOPEN(FADC250_DECODER_BANK,BT_UI4,blockLevel);
-
-  timeout = 0;
-  while((faBready(fadc_params[UITF_RUN_TYPE].slot) != 1) && (timeout<maxtime))
+  /* Helicity-correlated sums of this block (only set up for the
+     integrating run type) */
+  if(hd && uitfAsym)
     {
-      timeout++;
+      uitfAsymReadout();
+      uitfPerfMark(UITF_PERF_ASYM, &t);
     }
 
-  if(timeout>=maxtime)
+  /* fadc250 raw windows to pulse parameters */
+  if(uitfPulse)
     {
-      printf("%s: ERROR: TIMEOUT waiting for FADC (slot = %d) Block Ready\n",
-	     __func__, fadc_params[UITF_RUN_TYPE].slot);
+      uitfPulseReadout(ev_num);
+      uitfPerfMark(UITF_PERF_PULSE, &t);
     }
-  else
+
+  /* Check for SYNC Event */
+  if(sync && (tiGetSyncEventFlag() == 1))
     {
-      int32_t blockError = 0;
+      /* Stop the prefetch thread, and drop what it has read ahead */
+      if(path == UITF_PATH_PIPE)
+	uitfPipePause(ev_num, 1);
 
-      dCnt = faReadBlock(fadc_params[UITF_RUN_TYPE].slot, dma_dabufp, MAXFADCWORDS, 1);
+      /* Drain what is left in the modules, within the time budget */
+      uitfSyncDrain(ev_num, hd);
 
-      blockError = faGetBlockError(1);
-      if(blockError)
-	{
-	  printf("ERROR: Slot %d: in transfer (event = %d), dCnt = 0x%x\n",
-		 fadc_params[UITF_RUN_TYPE].slot, ev_num, dCnt);
+      if(path == UITF_PATH_PIPE)
+	uitfPipeResume();
+      uitfPerfMark(UITF_PERF_SYNC, &t);
+    }
 
-	  if(dCnt > 0)
-	    dma_dabufp += dCnt;
-	}
-      else
-	{
-	  dma_dabufp += dCnt;
-	}
+  /* Resync the modules with errors or timeouts in this block */
+  if(uitfRecoverMask)
+    uitfRecover(ev_num, hd);
+
+  uitfPerfMark(UITF_PERF_TRIGGER, &tstart);
+
+  /* Timing histograms for this run, so far */
+  if(uitfPerfDue(readout_params.perf_interval))
+    {
+      BANKOPEN(UITF_PERF_BANK, BT_UI4, blockLevel);
+      dCnt = uitfPerfFill(dma_dabufp, UITF_PERF_MAXWORDS);
+      if(dCnt > 0)
+	dma_dabufp += dCnt;
+      BANKCLOSE;
     }
-  BANKCLOSE;
 
-  /* Check for SYNC Event */
-  if(tiGetSyncEventFlag() == 1)
+  /* Helicity asymmetry summary */
+  if(hd && uitfAsym && uitfAsymDue(readout_params.asym_interval))
     {
-      /* Check for data available */
-      int davail = tiBReady();
-      if(davail > 0)
-	{
-	  printf("%s: ERROR: TI Data available (%d) after readout in SYNC event \n",
-		 __func__, davail);
+      BANKOPEN(UITF_ASYM_BANK, BT_UI4, blockLevel);
+      dCnt = uitfAsymFill(dma_dabufp, UITF_ASYM_MAXWORDS(uitfFaN));
+      if(dCnt > 0)
+	dma_dabufp += dCnt;
+      BANKCLOSE;
+    }
+}
 
-	  while(tiBReady())
-	    {
-	      vmeDmaFlush(tiGetAdr32());
-	    }
-	}
 
-      if(hd_params.enabled)
-	{
-	  davail = hdBReady();
-	  if(davail > 0)
-	    {
-	      printf("%s: ERROR: Helicity Decoder Data available (%d) after readout in SYNC event \n",
-		     __func__, davail);
+/* Trigger routine variants: module readout path x helicity decoder x
+   SYNC event check, the settings the readout tests on every block.  Each
+   is uitfTriggerBody with constant arguments, so at -O2 (the Makefile's
+   default) the branches on them fold away.  One is selected at Download
+   (uitfTriggerSelect), after the pipeline and chained DMA setup.
+   Still tested at run time, once per block: the optional stages (asym,
+   pulse, timing and asymmetry banks, resync), and the loop over the
+   fadc250s read, which loads uitfFaN, uitfFaIndex and fadc_params.
+
+   X(name, path, hd enabled, sync check).  Chained DMA needs the HD */
+#define UITF_TRIGGER_VARIANTS					\
+  X(DirectHdSync,   UITF_PATH_DIRECT, 1, 1)			\
+  X(DirectHd,       UITF_PATH_DIRECT, 1, 0)			\
+  X(DirectSync,     UITF_PATH_DIRECT, 0, 1)			\
+  X(Direct,         UITF_PATH_DIRECT, 0, 0)			\
+  X(ChainHdSync,    UITF_PATH_CHAIN,  1, 1)			\
+  X(ChainHd,        UITF_PATH_CHAIN,  1, 0)			\
+  X(PipeHdSync,     UITF_PATH_PIPE,   1, 1)			\
+  X(PipeHd,         UITF_PATH_PIPE,   1, 0)			\
+  X(PipeSync,       UITF_PATH_PIPE,   0, 1)			\
+  X(Pipe,           UITF_PATH_PIPE,   0, 0)
+
+#define X(name, path, hd, sync)					\
+  static void uitfTrigger##name(int arg)			\
+  { uitfTriggerBody(arg, path, hd, sync); }
+UITF_TRIGGER_VARIANTS
+#undef X
+
+typedef struct
+{
+  const char *name;
+  int32_t path;
+  int32_t hd;
+  int32_t sync;
+  void (*trigger)(int arg);
+} uitf_trigger_variant_t;
+
+#define X(name, path, hd, sync)					\
+  { #name, path, hd, sync, uitfTrigger##name },
+const uitf_trigger_variant_t uitfTriggerVariant[] =
+  {
+    UITF_TRIGGER_VARIANTS
+  };
+#undef X
+
+#define UITF_NTRIGGER_VARIANT \
+  (sizeof(uitfTriggerVariant) / sizeof(uitf_trigger_variant_t))
+
+void (*uitfTrigger)(int arg) = uitfTriggerDirectHdSync;
+
+static int32_t
+uitfTriggerSelect()
+{
+  uint32_t ivar;
+  int32_t hd = hd_params.enabled ? 1 : 0;
+  int32_t sync = readout_params.sync_check ? 1 : 0;
+  int32_t path = UITF_PATH_DIRECT;
 
-	      while(hdBReady(0))
-		{
-		  vmeDmaFlush(hdGetA32());
-		}
-	    }
-	}
+  if(uitfPipeline)
+    path = UITF_PATH_PIPE;
+  else if(uitfChainedDma)
+    path = UITF_PATH_CHAIN;
 
-      davail = faBready(fadc_params[UITF_RUN_TYPE].slot);
-      if(davail > 0)
-	{
-	  printf("%s: ERROR: fADC250 Data available (%d) after readout in SYNC event \n",
-		 __func__, davail);
+  for(ivar = 0; ivar < UITF_NTRIGGER_VARIANT; ivar++)
+    {
+      const uitf_trigger_variant_t *v = &uitfTriggerVariant[ivar];
 
-	  while(faBready(fadc_params[UITF_RUN_TYPE].slot))
-	    {
-	      vmeDmaFlush(faGetA32(fadc_params[UITF_RUN_TYPE].slot));
-	    }
+      if((v->path == path) && (v->hd == hd) && (v->sync == sync))
+	{
+	  uitfTrigger = v->trigger;
+	  printf("%s: rocTrigger variant %s\n", __func__, v->name);
+	  return 0;
 	}
     }
+
+  daLogMsg("ERROR", "No rocTrigger variant for readout path %d, hd %d, sync check %d",
+	   path, hd, sync);
+  return -1;
+}
+
+void
+rocTrigger(int arg)
+{
+  (*uitfTrigger)(arg);
 }
 
 void
@@ -383,9 +2412,14 @@ rocLoad()
 void
 rocCleanup()
 {
+  uitfPipeStop();
+  uitfStatusClose();
+  uitfErrLogClose();
+
   printf("%s: Reset all Modules\n",__FUNCTION__);
   tiResetSlaveConfig();
   faGReset(1);
+  uitf_config_modules_invalidate();
   dalmaClose();
 }
 
@@ -0,0 +1,221 @@
+/*************************************************************************
+ *
+ *  uitf_perf.c - Per stage timing of the readout, in fixed memory
+ *
+ *    The TSC is read with rdtsc (CLOCK_MONOTONIC where there is none)
+ *    and calibrated against CLOCK_MONOTONIC in uitfPerfInit.  Ticks are
+ *    converted to ns with a fixed point multiply, so a mark costs a TSC
+ *    read, a multiply and a few adds.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "uitf_perf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define UITF_PERF_TSC 1
+#endif
+
+#define UITF_PERF_SHIFT 24
+
+static const char **perfName = NULL;
+static int32_t perfNstage = 0;
+static uitf_perf_stage_t perfStage[UITF_PERF_MAXSTAGE];
+
+static uint64_t perfTicksPerSec = 1000000000ULL;
+static uint64_t perfNsMult = 1ULL << UITF_PERF_SHIFT;	/* ns per tick << SHIFT */
+static uint64_t perfStart = 0, perfNext = 0;
+
+static uint64_t
+uitfPerfClock()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t
+uitfPerfNow()
+{
+#ifdef UITF_PERF_TSC
+  return __rdtsc();
+#else
+  return uitfPerfClock();
+#endif
+}
+
+/**
+ * @details Set the stage names, calibrate the TSC, and clear the histograms
+ * @param[in] names Name of each stage
+ * @param[in] nstage Number of stages (up to UITF_PERF_MAXSTAGE)
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+uitfPerfInit(const char **names, int32_t nstage)
+{
+  if((names == NULL) || (nstage <= 0) || (nstage > UITF_PERF_MAXSTAGE))
+    {
+      printf("%s: ERROR: Invalid stages (%d)\n", __func__, nstage);
+      return -1;
+    }
+
+  perfName = names;
+  perfNstage = nstage;
+
+#ifdef UITF_PERF_TSC
+  {
+    struct timespec ts = {0, 10000000};	/* 10 ms */
+    uint64_t c0, c1, t0, t1;
+
+    c0 = uitfPerfClock();
+    t0 = __rdtsc();
+    nanosleep(&ts, NULL);
+    c1 = uitfPerfClock();
+    t1 = __rdtsc();
+
+    if((t1 > t0) && (c1 > c0))
+      {
+	perfTicksPerSec = ((t1 - t0) * 1000000000ULL) / (c1 - c0);
+	perfNsMult = ((c1 - c0) << UITF_PERF_SHIFT) / (t1 - t0);
+      }
+  }
+#endif
+
+  printf("%s: %.3f MHz timestamp\n", __func__, perfTicksPerSec / 1e6);
+
+  uitfPerfReset();
+
+  return 0;
+}
+
+/**
+ * @details Clear the histograms and restart the uitfPerfDue interval
+ */
+void
+uitfPerfReset()
+{
+  memset(perfStage, 0, sizeof(perfStage));
+  perfStart = uitfPerfNow();
+  perfNext = 0;
+}
+
+/**
+ * @details Add the time since *t to a stage, and set *t to now
+ * @param[in] stage Stage index
+ * @param[in,out] t Timestamp (uitfPerfNow) at the start of the stage
+ */
+void
+uitfPerfMark(int32_t stage, uint64_t *t)
+{
+  uint64_t now = uitfPerfNow(), ns;
+  uitf_perf_stage_t *st = &perfStage[stage];
+  int32_t ibin = 0;
+
+  ns = ((now - *t) * perfNsMult) >> UITF_PERF_SHIFT;
+  *t = now;
+
+  st->count++;
+  st->sum_ns += ns;
+  if(ns > st->max_ns)
+    st->max_ns = ns;
+
+  if(ns)
+    {
+      ibin = 64 - __builtin_clzll(ns);
+      if(ibin >= UITF_PERF_NBINS)
+	ibin = UITF_PERF_NBINS - 1;
+    }
+  st->hist[ibin]++;
+}
+
+/**
+ * @details Check if the histograms are due to be written
+ * @param[in] interval_s Seconds between writes.  0 for never.
+ * @return 1 if due (and restarts the interval), otherwise 0
+ */
+int32_t
+uitfPerfDue(uint32_t interval_s)
+{
+  uint64_t now;
+
+  if(interval_s == 0)
+    return 0;
+
+  now = uitfPerfNow();
+  if(perfNext == 0)
+    perfNext = perfStart + interval_s * perfTicksPerSec;
+
+  if(now < perfNext)
+    return 0;
+
+  perfNext = now + interval_s * perfTicksPerSec;
+  return 1;
+}
+
+/**
+ * @details Pack the histograms into a buffer
+ *
+ *   word 0  : version << 24 | nstage << 8 | nbins
+ *   word 1  : seconds since uitfPerfReset
+ *   per stage: count, sum (us), max (ns), nbins histogram counts
+ *
+ * @param[in] buf Destination
+ * @param[in] maxwords Space in buf, in words
+ * @return Number of words filled, or -1 if they do not fit
+ */
+int32_t
+uitfPerfFill(volatile uint32_t *buf, int32_t maxwords)
+{
+  int32_t istage, ibin, nwords = 0;
+
+  if(maxwords < 2 + perfNstage * (3 + UITF_PERF_NBINS))
+    return -1;
+
+  buf[nwords++] = (UITF_PERF_VERSION << 24) | (perfNstage << 8) | UITF_PERF_NBINS;
+  buf[nwords++] = (uitfPerfNow() - perfStart) / perfTicksPerSec;
+
+  for(istage = 0; istage < perfNstage; istage++)
+    {
+      uitf_perf_stage_t *st = &perfStage[istage];
+
+      buf[nwords++] = st->count;
+      buf[nwords++] = st->sum_ns / 1000;
+      buf[nwords++] = st->max_ns;
+      for(ibin = 0; ibin < UITF_PERF_NBINS; ibin++)
+	buf[nwords++] = st->hist[ibin];
+    }
+
+  return nwords;
+}
+
+/**
+ * @details Print the mean, max, and non-empty histogram bins of each stage
+ */
+void
+uitfPerfPrint()
+{
+  int32_t istage, ibin;
+
+  for(istage = 0; istage < perfNstage; istage++)
+    {
+      uitf_perf_stage_t *st = &perfStage[istage];
+
+      printf("%s: %-10s n %llu  mean %.2f us  max %.2f us\n",
+	     __func__, perfName[istage], (unsigned long long)st->count,
+	     st->count ? (st->sum_ns / 1000.) / st->count : 0.,
+	     st->max_ns / 1000.);
+
+      if(st->count == 0)
+	continue;
+
+      printf("%s: %-10s ns <", __func__, perfName[istage]);
+      for(ibin = 0; ibin < UITF_PERF_NBINS; ibin++)
+	if(st->hist[ibin])
+	  printf("  %llu:%u", 1ULL << ibin, st->hist[ibin]);
+      printf("\n");
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+/*************************************************************************
+ *
+ *  uitf_perf.h - Per stage timing of the readout, in fixed memory
+ *
+ *    Stage times are taken from the TSC and filled into log2(ns)
+ *    histograms.  The histograms can be packed into a bank for the
+ *    data stream (uitfPerfFill) and printed (uitfPerfPrint).
+ *
+ */
+
+#include <stdint.h>
+
+#define UITF_PERF_MAXSTAGE  12
+#define UITF_PERF_NBINS     24	/* log2(ns) bins: <1ns .. >=8ms */
+#define UITF_PERF_VERSION    1
+
+typedef struct
+{
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint32_t hist[UITF_PERF_NBINS];
+} uitf_perf_stage_t;
+
+int32_t  uitfPerfInit(const char **names, int32_t nstage);
+void     uitfPerfReset();
+uint64_t uitfPerfNow();
+void     uitfPerfMark(int32_t stage, uint64_t *t);
+int32_t  uitfPerfDue(uint32_t interval_s);
+int32_t  uitfPerfFill(volatile uint32_t *buf, int32_t maxwords);
+void     uitfPerfPrint();
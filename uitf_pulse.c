@@ -0,0 +1,542 @@
+/*************************************************************************
+ *
+ *  uitf_pulse.c - fadc250 raw window reduction to pulse parameters
+ *
+ *    A window is unpacked to 16 bit samples, then the pedestal, the
+ *    threshold crossings, integrals and peaks are found with SIMD
+ *    kernels: AVX2 where the CPU has it (checked at uitfPulseInit),
+ *    SSE2 on other x86_64, and plain C elsewhere.  The AVX2 kernels are
+ *    built with a target attribute, so the library needs no -mavx2.
+ *
+ *    A pulse starts where a sample goes over the pedestal + the channel
+ *    threshold, and spans nsb samples before to nsa samples after.  The
+ *    time is where the leading edge crosses half the peak (over
+ *    pedestal), in 1/64 samples.  The search for the next pulse starts
+ *    after the last.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "uitf_pulse.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define UITF_PULSE_X86 1
+#endif
+
+#define UITF_PULSE_TYPE(w)  (((w) >> 27) & 0xf)
+#define UITF_PULSE_DEFINE   0x80000000
+enum
+  {
+    UITF_PULSE_BLOCK_HEADER = 0,
+    UITF_PULSE_BLOCK_TRAILER = 1,
+    UITF_PULSE_EVENT_HEADER = 2,
+    UITF_PULSE_WINDOW_RAW = 4,
+    UITF_PULSE_PARAMETER = 9,
+    UITF_PULSE_FILLER = 15
+  };
+
+/* Worst case words for one window, plus a block trailer and filler */
+#define UITF_PULSE_MAXOUT (1 + 2 * UITF_PULSE_MAXNP + 2)
+
+typedef struct
+{
+  const char *name;
+  void    (*unpack)(const uint32_t *w, int16_t *s, int32_t nwords);
+  int32_t (*sum)(const int16_t *s, int32_t n);
+  int32_t (*above)(const int16_t *s, int32_t n, int16_t thr);
+  int32_t (*peak)(const int16_t *s, int32_t n);
+} uitf_pulse_kernels_t;
+
+static uitf_pulse_board_t pulseBoard[UITF_PULSE_MAXBOARD];
+static int32_t pulseNboard = 0;
+static int8_t pulseBoardOf[32];	/* by slot, -1 if not reduced */
+static int16_t pulseSample[UITF_PULSE_MAXPTW + 16];
+
+/* This run */
+static uint64_t pulseWordsIn = 0, pulseWordsOut = 0;
+static uint64_t pulseWindows = 0, pulsePulses = 0;
+
+/*************************************************************************
+ *  Kernels: plain C
+ */
+
+/* Two samples per word, first in the upper half.  Flag bits dropped */
+static void
+uitfPulseUnpackC(const uint32_t *w, int16_t *s, int32_t nwords)
+{
+  int32_t i;
+
+  for(i = 0; i < nwords; i++)
+    {
+      s[2 * i] = (w[i] >> 16) & 0xfff;
+      s[2 * i + 1] = w[i] & 0xfff;
+    }
+}
+
+static int32_t
+uitfPulseSumC(const int16_t *s, int32_t n)
+{
+  int32_t i, sum = 0;
+
+  for(i = 0; i < n; i++)
+    sum += s[i];
+
+  return sum;
+}
+
+/* First sample over thr, or n */
+static int32_t
+uitfPulseAboveC(const int16_t *s, int32_t n, int16_t thr)
+{
+  int32_t i;
+
+  for(i = 0; i < n; i++)
+    if(s[i] > thr)
+      return i;
+
+  return n;
+}
+
+/* First sample with the largest value */
+static int32_t
+uitfPulsePeakC(const int16_t *s, int32_t n)
+{
+  int32_t i, imax = 0;
+
+  for(i = 1; i < n; i++)
+    if(s[i] > s[imax])
+      imax = i;
+
+  return imax;
+}
+
+static const uitf_pulse_kernels_t pulseKernelsC =
+  {
+    "C", uitfPulseUnpackC, uitfPulseSumC, uitfPulseAboveC, uitfPulsePeakC
+  };
+
+#ifdef UITF_PULSE_X86
+/*************************************************************************
+ *  Kernels: SSE2 (every x86_64)
+ */
+
+/* Swap the 16 bit halves of each word, so samples land in order */
+static void
+uitfPulseUnpackSse2(const uint32_t *w, int16_t *s, int32_t nwords)
+{
+  const __m128i mask = _mm_set1_epi32(0x0fff0fff);
+  int32_t i = 0;
+
+  for(; i + 4 <= nwords; i += 4)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *)(w + i));
+
+      v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+      _mm_storeu_si128((__m128i *)(s + 2 * i), _mm_and_si128(v, mask));
+    }
+  uitfPulseUnpackC(w + i, s + 2 * i, nwords - i);
+}
+
+static int32_t
+uitfPulseSumSse2(const int16_t *s, int32_t n)
+{
+  const __m128i ones = _mm_set1_epi16(1);
+  __m128i acc = _mm_setzero_si128();
+  int32_t i = 0;
+
+  for(; i + 8 <= n; i += 8)
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(s + i)),
+					    ones));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+  acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+
+  return _mm_cvtsi128_si32(acc) + uitfPulseSumC(s + i, n - i);
+}
+
+static int32_t
+uitfPulseAboveSse2(const int16_t *s, int32_t n, int16_t thr)
+{
+  const __m128i t = _mm_set1_epi16(thr);
+  int32_t i = 0, m;
+
+  for(; i + 8 <= n; i += 8)
+    {
+      m = _mm_movemask_epi8(_mm_cmpgt_epi16(_mm_loadu_si128((const __m128i *)(s + i)), t));
+      if(m)
+	return i + (__builtin_ctz(m) >> 1);
+    }
+
+  return i + uitfPulseAboveC(s + i, n - i, thr);
+}
+
+static int32_t
+uitfPulsePeakSse2(const int16_t *s, int32_t n)
+{
+  __m128i vmax;
+  int32_t i;
+  int16_t max;
+
+  if(n < 8)
+    return uitfPulsePeakC(s, n);
+
+  vmax = _mm_loadu_si128((const __m128i *)s);
+  for(i = 8; i + 8 <= n; i += 8)
+    vmax = _mm_max_epi16(vmax, _mm_loadu_si128((const __m128i *)(s + i)));
+  vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, 0x4e));
+  vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, 0xb1));
+  vmax = _mm_max_epi16(vmax, _mm_shufflelo_epi16(vmax, 0xb1));
+  max = (int16_t)_mm_cvtsi128_si32(vmax);
+  for(; i < n; i++)
+    if(s[i] > max)
+      max = s[i];
+
+  return uitfPulseAboveSse2(s, n, max - 1);
+}
+
+static const uitf_pulse_kernels_t pulseKernelsSse2 =
+  {
+    "SSE2", uitfPulseUnpackSse2, uitfPulseSumSse2, uitfPulseAboveSse2, uitfPulsePeakSse2
+  };
+
+/*************************************************************************
+ *  Kernels: AVX2
+ */
+
+__attribute__((target("avx2"))) static void
+uitfPulseUnpackAvx2(const uint32_t *w, int16_t *s, int32_t nwords)
+{
+  const __m256i mask = _mm256_set1_epi32(0x0fff0fff);
+  int32_t i = 0;
+
+  for(; i + 8 <= nwords; i += 8)
+    {
+      __m256i v = _mm256_loadu_si256((const __m256i *)(w + i));
+
+      v = _mm256_or_si256(_mm256_slli_epi32(v, 16), _mm256_srli_epi32(v, 16));
+      _mm256_storeu_si256((__m256i *)(s + 2 * i), _mm256_and_si256(v, mask));
+    }
+  uitfPulseUnpackSse2(w + i, s + 2 * i, nwords - i);
+}
+
+__attribute__((target("avx2"))) static int32_t
+uitfPulseSumAvx2(const int16_t *s, int32_t n)
+{
+  const __m256i ones = _mm256_set1_epi16(1);
+  __m256i acc = _mm256_setzero_si256();
+  __m128i acc128;
+  int32_t i = 0;
+
+  for(; i + 16 <= n; i += 16)
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *)(s + i)),
+						  ones));
+  acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  acc128 = _mm_add_epi32(acc128, _mm_shuffle_epi32(acc128, 0x4e));
+  acc128 = _mm_add_epi32(acc128, _mm_shuffle_epi32(acc128, 0xb1));
+
+  return _mm_cvtsi128_si32(acc128) + uitfPulseSumSse2(s + i, n - i);
+}
+
+__attribute__((target("avx2"))) static int32_t
+uitfPulseAboveAvx2(const int16_t *s, int32_t n, int16_t thr)
+{
+  const __m256i t = _mm256_set1_epi16(thr);
+  int32_t i = 0;
+  uint32_t m;
+
+  for(; i + 16 <= n; i += 16)
+    {
+      m = _mm256_movemask_epi8(_mm256_cmpgt_epi16(_mm256_loadu_si256((const __m256i *)(s + i)),
+						  t));
+      if(m)
+	return i + (__builtin_ctz(m) >> 1);
+    }
+
+  return i + uitfPulseAboveSse2(s + i, n - i, thr);
+}
+
+__attribute__((target("avx2"))) static int32_t
+uitfPulsePeakAvx2(const int16_t *s, int32_t n)
+{
+  __m256i vmax;
+  __m128i v;
+  int32_t i;
+  int16_t max;
+
+  if(n < 16)
+    return uitfPulsePeakSse2(s, n);
+
+  vmax = _mm256_loadu_si256((const __m256i *)s);
+  for(i = 16; i + 16 <= n; i += 16)
+    vmax = _mm256_max_epi16(vmax, _mm256_loadu_si256((const __m256i *)(s + i)));
+  v = _mm_max_epi16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+  v = _mm_max_epi16(v, _mm_shuffle_epi32(v, 0x4e));
+  v = _mm_max_epi16(v, _mm_shuffle_epi32(v, 0xb1));
+  v = _mm_max_epi16(v, _mm_shufflelo_epi16(v, 0xb1));
+  max = (int16_t)_mm_cvtsi128_si32(v);
+  for(; i < n; i++)
+    if(s[i] > max)
+      max = s[i];
+
+  return uitfPulseAboveAvx2(s, n, max - 1);
+}
+
+static const uitf_pulse_kernels_t pulseKernelsAvx2 =
+  {
+    "AVX2", uitfPulseUnpackAvx2, uitfPulseSumAvx2, uitfPulseAboveAvx2, uitfPulsePeakAvx2
+  };
+#endif /* UITF_PULSE_X86 */
+
+static const uitf_pulse_kernels_t *pulseK = &pulseKernelsC;
+
+/**
+ * @details Set the fadc250s to reduce, pick the kernels for this CPU,
+ *          and clear the counters
+ * @param[in] boards Pulse settings of each fadc250
+ * @param[in] nboard Number of fadc250s
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+uitfPulseInit(const uitf_pulse_board_t *boards, int32_t nboard)
+{
+  int32_t iboard;
+
+  if((boards == NULL) || (nboard <= 0) || (nboard > UITF_PULSE_MAXBOARD))
+    {
+      printf("%s: ERROR: Invalid fadc250s (%d)\n", __func__, nboard);
+      return -1;
+    }
+
+  memset(pulseBoardOf, -1, sizeof(pulseBoardOf));
+  for(iboard = 0; iboard < nboard; iboard++)
+    {
+      uitf_pulse_board_t *b = &pulseBoard[iboard];
+
+      *b = boards[iboard];
+      if(b->np == 0)
+	b->np = 1;
+      if(b->np > UITF_PULSE_MAXNP)
+	b->np = UITF_PULSE_MAXNP;
+      pulseBoardOf[b->slot & 0x1f] = iboard;
+    }
+  pulseNboard = nboard;
+
+#ifdef UITF_PULSE_X86
+  __builtin_cpu_init();
+  pulseK = __builtin_cpu_supports("avx2") ? &pulseKernelsAvx2 : &pulseKernelsSse2;
+#else
+  pulseK = &pulseKernelsC;
+#endif
+
+  printf("%s: %d fadc250, %s kernels\n", __func__, pulseNboard, pulseK->name);
+
+  uitfPulseReset();
+
+  return 0;
+}
+
+/**
+ * @details Clear the counters of this run
+ */
+void
+uitfPulseReset()
+{
+  pulseWordsIn = pulseWordsOut = 0;
+  pulseWindows = pulsePulses = 0;
+}
+
+/**
+ * @return Name of the kernels in use
+ */
+const char *
+uitfPulseIsa()
+{
+  return pulseK->name;
+}
+
+/* Pulses of one window.  Returns the words written */
+static int32_t
+uitfPulseWindow(const uitf_pulse_board_t *b, uint32_t ev, uint32_t ch,
+		const int16_t *s, int32_t ns, volatile uint32_t *out)
+{
+  int32_t ped4, ped, nped, thr, i = 0, iw = 1, npulse = 0;
+  int32_t tc, lo, hi, ip, k, vp, vmid2, integral, t, nover, quality;
+
+  nped = (ns < UITF_PULSE_NPED) ? ns : UITF_PULSE_NPED;
+  ped4 = pulseK->sum(s, nped);
+  ped = (ped4 + (nped >> 1)) / nped;
+  thr = ped + (b->threshold[ch] ? (int32_t)b->threshold[ch] : UITF_PULSE_HEIGHT);
+
+  while((npulse < (int32_t)b->np) && (i < ns))
+    {
+      tc = i + pulseK->above(s + i, ns - i, thr);
+      if(tc >= ns)
+	break;
+
+      quality = 0;
+      lo = tc - (int32_t)b->nsb;
+      if(lo < 0)
+	lo = 0;
+      hi = tc + (int32_t)b->nsa + 1;
+      if(hi > ns)
+	{
+	  hi = ns;
+	  quality |= 0x1;
+	}
+
+      /* Not pedestal subtracted, as the firmware's */
+      integral = pulseK->sum(s + lo, hi - lo);
+      if(integral > 0x3ffff)
+	integral = 0x3ffff;
+
+      for(k = tc, nover = 0; k < hi; k++)
+	nover += (s[k] > thr);
+
+      ip = tc + pulseK->peak(s + tc, hi - tc);
+      vp = s[ip];
+
+      /* Leading edge at half the peak over pedestal (x2, in integers) */
+      vmid2 = vp + ped;
+      k = ip;
+      while((k > lo) && ((2 * s[k - 1]) >= vmid2))
+	k--;
+      if((k > lo) && (s[k] > s[k - 1]))
+	t = (k - 1) * 64 + (64 * (vmid2 - 2 * s[k - 1])) / (2 * (s[k] - s[k - 1]));
+      else
+	t = k * 64;
+
+      if(t > UITF_PULSE_MAXTIME)
+	t = UITF_PULSE_MAXTIME;
+      if(nover > 0x1ff)
+	nover = 0x1ff;
+
+      out[iw++] = (1 << 30) | (integral << 12) | (quality << 9) | nover;
+      out[iw++] = (t << 15) | (vp & 0xfff);
+      npulse++;
+      i = hi;
+    }
+
+  out[0] = UITF_PULSE_DEFINE | (UITF_PULSE_PARAMETER << 27) | ((ev & 0xff) << 19) |
+    ((ch & 0xf) << 15) | (ped4 & 0x3fff);
+  pulsePulses += npulse;
+
+  return iw;
+}
+
+/**
+ * @details Copy a block of fadc250 data, with each raw window of the
+ *          reduced fadc250s replaced by its pulse data
+ * @param[in] in fadc250 blocks (bank contents)
+ * @param[in] nwords Words in the fadc250 blocks
+ * @param[out] out Where to write
+ * @param[in] maxwords Space in out
+ * @return Words written, or -1 if out is too small
+ */
+int32_t
+uitfPulseBlock(volatile uint32_t *in, int32_t nwords,
+	       volatile uint32_t *out, int32_t maxwords)
+{
+  const uitf_pulse_board_t *b = NULL;
+  int32_t iw = 0, io = 0, iheader = -1, nw, nblock;
+  uint32_t w, slot = 0, ptw, ev = 0;
+
+  while(iw < nwords)
+    {
+      if((io + UITF_PULSE_MAXOUT) > maxwords)
+	return -1;
+
+      w = in[iw];
+      if(!(w & UITF_PULSE_DEFINE))
+	{
+	  out[io++] = in[iw++];
+	  continue;
+	}
+
+      switch(UITF_PULSE_TYPE(w))
+	{
+	case UITF_PULSE_BLOCK_HEADER:
+	  slot = (w >> 22) & 0x1f;
+	  b = (pulseBoardOf[slot] >= 0) ? &pulseBoard[(int32_t)pulseBoardOf[slot]] : NULL;
+	  iheader = io;
+	  ev = 0;
+	  out[io++] = in[iw++];
+	  break;
+
+	case UITF_PULSE_EVENT_HEADER:
+	  ev++;
+	  out[io++] = in[iw++];
+	  break;
+
+	case UITF_PULSE_BLOCK_TRAILER:
+	  /* Word count from the block header, then filler to 64 bits */
+	  iw++;
+	  if(iheader < 0)
+	    {
+	      out[io++] = w;
+	      break;
+	    }
+	  nblock = io - iheader + 1;
+	  out[io++] = (w & ~0x3fffff) | (nblock & 0x3fffff);
+	  if(nblock & 0x1)
+	    out[io++] = UITF_PULSE_DEFINE | (UITF_PULSE_FILLER << 27) | (slot << 22);
+	  iheader = -1;
+	  break;
+
+	case UITF_PULSE_FILLER:
+	  iw++;
+	  break;
+
+	case UITF_PULSE_WINDOW_RAW:
+	  ptw = w & 0xfff;
+	  nw = (ptw + 1) >> 1;
+	  if((b == NULL) || (ptw == 0) || (ptw > UITF_PULSE_MAXPTW) ||
+	     ((iw + 1 + nw) > nwords))
+	    {
+	      /* Not reduced.  The samples are copied as continuation words */
+	      out[io++] = in[iw++];
+	      break;
+	    }
+
+	  /* The firmware has made the pulse parameters already */
+	  if(b->firmware)
+	    {
+	      iw += 1 + nw;
+	      break;
+	    }
+
+	  pulseK->unpack((const uint32_t *)(in + iw + 1), pulseSample, nw);
+	  io += uitfPulseWindow(b, ev, (w >> 23) & 0xf, pulseSample, ptw, out + io);
+	  iw += 1 + nw;
+	  pulseWindows++;
+	  break;
+
+	default:
+	  out[io++] = in[iw++];
+	  break;
+	}
+    }
+
+  pulseWordsIn += nwords;
+  pulseWordsOut += io;
+
+  return io;
+}
+
+/**
+ * @details Print the reduction of this run
+ */
+void
+uitfPulsePrint()
+{
+  if(pulseWordsIn == 0)
+    return;
+
+  printf("%s: %llu windows, %llu pulses (%s kernels)\n", __func__,
+	 (unsigned long long)pulseWindows, (unsigned long long)pulsePulses,
+	 pulseK->name);
+  printf("%s: fadc250 words %llu -> %llu (%.1f x smaller)\n", __func__,
+	 (unsigned long long)pulseWordsIn, (unsigned long long)pulseWordsOut,
+	 pulseWordsOut ? (double)pulseWordsIn / pulseWordsOut : 0.);
+}
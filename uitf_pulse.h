@@ -0,0 +1,53 @@
+#pragma once
+/*************************************************************************
+ *
+ *  uitf_pulse.h - fadc250 raw window reduction to pulse parameters
+ *
+ *    The raw windows of a block of fadc250 data are replaced by pulse
+ *    parameter (type 9) words, in the layout of the firmware's mode 9.
+ *    All other words (headers, trigger time, firmware pulse data) are
+ *    copied through, and the block trailer word count is corrected.
+ *    Boards whose firmware makes its own pulse parameters (mode 10) have
+ *    their raw windows dropped, not reduced.
+ *
+ *    Pulse parameters, per channel with a raw window:
+ *      word 1: 1 << 31 | 9 << 27 | event in block (1..) << 19 |
+ *              channel << 15 | pedestal sum (UITF_PULSE_NPED samples, 14 bits)
+ *      per pulse
+ *        word 2: 1 << 30 | integral (NSB + NSA samples, 18 bits) << 12 |
+ *                quality << 9 | samples over threshold (9 bits)
+ *                quality bit 0: the pulse runs past the window
+ *        word 3: time (1/64 sample: coarse 9 bits, fine 6 bits) << 15 |
+ *                peak (12 bits)
+ *
+ *    A pulse starts at a sample over the pedestal + the channel's
+ *    threshold (as the firmware's TET).
+ *
+ */
+
+#include <stdint.h>
+
+#define UITF_PULSE_NCHAN    16
+#define UITF_PULSE_MAXBOARD 20
+#define UITF_PULSE_MAXNP    4	/* pulses per window */
+#define UITF_PULSE_NPED     4	/* samples at the start of the window */
+#define UITF_PULSE_HEIGHT   20	/* over pedestal, for channels without a threshold */
+#define UITF_PULSE_MAXTIME  0x7fff	/* 1/64 samples */
+#define UITF_PULSE_MAXPTW   4096
+
+typedef struct
+{
+  uint32_t slot;
+  uint32_t nsb;			/* samples before the threshold crossing */
+  uint32_t nsa;			/* samples after */
+  uint32_t np;			/* pulses per window (1 to UITF_PULSE_MAXNP) */
+  uint32_t firmware;		/* firmware pulse parameters: raw windows dropped */
+  uint32_t threshold[UITF_PULSE_NCHAN];	/* over pedestal.  0: UITF_PULSE_HEIGHT */
+} uitf_pulse_board_t;
+
+int32_t     uitfPulseInit(const uitf_pulse_board_t *boards, int32_t nboard);
+void        uitfPulseReset();
+int32_t     uitfPulseBlock(volatile uint32_t *in, int32_t nwords,
+			   volatile uint32_t *out, int32_t maxwords);
+const char *uitfPulseIsa();
+void        uitfPulsePrint();
@@ -0,0 +1,158 @@
+/*************************************************************************
+ *
+ *  uitf_status.c - Module status dumps off the run control transition path
+ *
+ *    The caller reads the registers into a snapshot, and queues it.  The
+ *    background thread only formats it (the dump routine), so the
+ *    transition returns once the snapshot is queued, and the dump goes to
+ *    daLogMsg (DALMAGO) a moment later.  The dump routine must not touch
+ *    the modules: it runs alongside rocTrigger after Go.
+ *
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "uitf_status.h"
+
+static uitf_status_dump_t statusDump = NULL;
+static int32_t statusAsync = 0, statusRunning = 0;
+static pthread_t statusThread;
+static pthread_mutex_t statusMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t statusCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t statusIdle = PTHREAD_COND_INITIALIZER;
+
+static uitf_status_snapshot_t statusQueue[UITF_STATUS_QUEUE];
+static uint32_t statusHead = 0, statusTail = 0;
+static int32_t statusBusy = 0;
+
+static void *
+uitfStatusThread(void *arg)
+{
+  uitf_status_snapshot_t snap;
+
+  pthread_mutex_lock(&statusMutex);
+  while(statusRunning)
+    {
+      if(statusHead == statusTail)
+	{
+	  pthread_cond_wait(&statusCond, &statusMutex);
+	  continue;
+	}
+
+      snap = statusQueue[statusTail % UITF_STATUS_QUEUE];
+      statusTail++;
+      statusBusy = 1;
+      pthread_mutex_unlock(&statusMutex);
+
+      (*statusDump)(&snap);
+
+      pthread_mutex_lock(&statusMutex);
+      statusBusy = 0;
+      if(statusHead == statusTail)
+	pthread_cond_broadcast(&statusIdle);
+    }
+  pthread_mutex_unlock(&statusMutex);
+
+  return NULL;
+}
+
+/**
+ * @details Set the dump routine, and start the background thread
+ * @param[in] dump Routine printing the module status for a snapshot
+ * @param[in] async 1 to dump in the background, 0 to dump in uitfStatusRequest
+ * @return 0 if successful, otherwise -1
+ */
+int32_t
+uitfStatusInit(uitf_status_dump_t dump, int32_t async)
+{
+  if(dump == NULL)
+    {
+      printf("%s: ERROR: dump routine may not be NULL\n", __func__);
+      return -1;
+    }
+
+  uitfStatusClose();
+
+  statusDump = dump;
+  statusAsync = async;
+  if(!statusAsync)
+    return 0;
+
+  statusRunning = 1;
+  if(pthread_create(&statusThread, NULL, uitfStatusThread, NULL) != 0)
+    {
+      printf("%s: ERROR creating status thread. Status dumps are synchronous\n",
+	     __func__);
+      statusRunning = 0;
+      statusAsync = 0;
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * @details Queue a status dump for a snapshot taken by the caller.
+ *          Formats it synchronously if not async, or if the queue is full.
+ * @param[in] snap Snapshot (copied)
+ */
+void
+uitfStatusRequest(const uitf_status_snapshot_t *snap)
+{
+  int32_t queued = 0;
+
+  if(statusDump == NULL)
+    return;
+
+  if(statusAsync)
+    {
+      pthread_mutex_lock(&statusMutex);
+      if((statusHead - statusTail) < UITF_STATUS_QUEUE)
+	{
+	  statusQueue[statusHead % UITF_STATUS_QUEUE] = *snap;
+	  statusHead++;
+	  queued = 1;
+	  pthread_cond_signal(&statusCond);
+	}
+      pthread_mutex_unlock(&statusMutex);
+    }
+
+  if(!queued)
+    (*statusDump)(snap);
+}
+
+/**
+ * @details Wait for queued status dumps to finish
+ */
+void
+uitfStatusFlush()
+{
+  if(!statusAsync)
+    return;
+
+  pthread_mutex_lock(&statusMutex);
+  while((statusHead != statusTail) || statusBusy)
+    pthread_cond_wait(&statusIdle, &statusMutex);
+  pthread_mutex_unlock(&statusMutex);
+}
+
+/**
+ * @details Finish queued dumps and stop the background thread
+ */
+void
+uitfStatusClose()
+{
+  if(!statusRunning)
+    return;
+
+  uitfStatusFlush();
+
+  pthread_mutex_lock(&statusMutex);
+  statusRunning = 0;
+  pthread_cond_signal(&statusCond);
+  pthread_mutex_unlock(&statusMutex);
+
+  pthread_join(statusThread, NULL);
+  statusAsync = 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+/*************************************************************************
+ *
+ *  uitf_status.h - Module status dumps off the run control transition path
+ *
+ *    The module registers are read into a snapshot on the transition
+ *    thread, in one pass.  A background thread formats the snapshot and
+ *    sends it to daLogMsg.  It does no VME access, so it cannot get in
+ *    the way of rocTrigger.
+ *
+ */
+
+#include <stdint.h>
+
+#define UITF_STATUS_QUEUE 8
+#define UITF_STATUS_MAXFA 20
+#define UITF_STATUS_NCHAN 16
+
+typedef struct
+{
+  int32_t  slot;
+  int32_t  type;		/* UITF_COUNTING, UITF_INTEGRATING */
+  int32_t  bready;
+  uint16_t dac[UITF_STATUS_NCHAN];
+  uint16_t threshold[UITF_STATUS_NCHAN];
+} uitf_status_fadc_t;
+
+typedef struct
+{
+  const char *transition;
+  int32_t  run_number;
+  uint64_t time_ns;		/* CLOCK_MONOTONIC at the snapshot */
+
+  uint32_t ti_intcount;
+  int32_t  ti_bready;
+  int32_t  ti_blocklevel;
+  int32_t  ti_bufferlevel;
+  int32_t  ti_syncflag;
+
+  int32_t  hd_enabled;
+  int32_t  hd_bready;
+
+  int32_t  nfa;
+  uitf_status_fadc_t fa[UITF_STATUS_MAXFA];
+} uitf_status_snapshot_t;
+
+typedef void (*uitf_status_dump_t)(const uitf_status_snapshot_t *snap);
+
+int32_t uitfStatusInit(uitf_status_dump_t dump, int32_t async);
+void    uitfStatusRequest(const uitf_status_snapshot_t *snap);
+void    uitfStatusFlush();
+void    uitfStatusClose();
@@ -0,0 +1,146 @@
+/*************************************************************************
+ *
+ *  uitf_wait.c - Deadline based wait on a module's block ready
+ *
+ *    Replaces counting register reads as a timeout.  A poll is a VME
+ *    single cycle, so after the spin period the polls are spaced out
+ *    (1, 2, 4, ... us, up to UITF_WAIT_MAX_GAP_NS) to leave the bus
+ *    alone while a slow block is still being built.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "uitf_wait.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UITF_CPU_RELAX() __asm__ __volatile__("pause")
+#else
+#define UITF_CPU_RELAX()
+#endif
+
+static inline uint64_t
+uitfNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @details Initialize a wait with a name (for printing) and deadline
+ * @param[in] w Wait to initialize
+ * @param[in] name Module name
+ * @param[in] deadline_ns Deadline in ns.  0 for the default.
+ */
+void
+uitfWaitInit(uitf_wait_t *w, const char *name, uint64_t deadline_ns)
+{
+  memset(w, 0, sizeof(*w));
+  w->name = name;
+  w->deadline_ns = (deadline_ns == 0) ? UITF_WAIT_DEFAULT_NS : deadline_ns;
+}
+
+/**
+ * @details Clear the wait statistics, keeping the name and deadline
+ * @param[in] w Wait to reset
+ */
+void
+uitfWaitReset(uitf_wait_t *w)
+{
+  uitfWaitInit(w, w->name, w->deadline_ns);
+}
+
+/**
+ * @details Wait for ready(arg) to return 1, or the deadline to pass
+ * @param[in] w Wait parameters and statistics
+ * @param[in] ready Block ready routine
+ * @param[in] arg Argument to ready (e.g. slot number)
+ * @return 0 if ready, -1 if timed out
+ */
+int32_t
+uitfWait(uitf_wait_t *w, uitf_ready_t ready, int32_t arg)
+{
+  uint64_t start, now, next, elapsed, gap = 1000;
+  int32_t rval = -1, ibin = 0;
+
+  start = now = uitfNow();
+  next = start;
+
+  while(1)
+    {
+      if(now >= next)
+	{
+	  w->npoll++;
+	  if((*ready)(arg) == 1)
+	    {
+	      rval = 0;
+	      break;
+	    }
+
+	  now = uitfNow();
+	  if((now - start) >= w->deadline_ns)
+	    break;
+
+	  if((now - start) >= UITF_WAIT_SPIN_NS)
+	    {
+	      next = now + gap;
+	      if(gap < UITF_WAIT_MAX_GAP_NS)
+		gap <<= 1;
+	    }
+	}
+      else
+	{
+	  UITF_CPU_RELAX();
+	  now = uitfNow();
+	}
+    }
+
+  elapsed = uitfNow() - start;
+
+  w->nwait++;
+  w->sum_ns += elapsed;
+  if(elapsed > w->max_ns)
+    w->max_ns = elapsed;
+  if(rval != 0)
+    w->ntimeout++;
+
+  elapsed /= 1000;
+  while(elapsed && (ibin < (UITF_WAIT_NBINS - 1)))
+    {
+      elapsed >>= 1;
+      ibin++;
+    }
+  w->hist[ibin]++;
+
+  return rval;
+}
+
+/**
+ * @details Print the wait statistics
+ * @param[in] w Wait to print
+ */
+void
+uitfWaitPrint(uitf_wait_t *w)
+{
+  int32_t ibin;
+
+  printf("%s: %-8s deadline %8.1f us  waits %llu  timeouts %llu  polls %llu"
+	 "  mean %.2f us  max %.2f us\n",
+	 __func__, w->name, w->deadline_ns / 1000.,
+	 (unsigned long long)w->nwait, (unsigned long long)w->ntimeout,
+	 (unsigned long long)w->npoll,
+	 w->nwait ? (w->sum_ns / 1000.) / w->nwait : 0.,
+	 w->max_ns / 1000.);
+
+  if(w->nwait == 0)
+    return;
+
+  printf("%s: %-8s  us <", __func__, w->name);
+  for(ibin = 0; ibin < UITF_WAIT_NBINS; ibin++)
+    if(w->hist[ibin])
+      printf("  %u:%u", 1 << ibin, w->hist[ibin]);
+  printf("\n");
+}
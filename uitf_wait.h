@@ -0,0 +1,37 @@
+#pragma once
+/*************************************************************************
+ *
+ *  uitf_wait.h - Deadline based wait on a module's block ready
+ *
+ *    Polls back-to-back for a short spin period, then with
+ *    exponentially spaced polls until the deadline (in ns, from
+ *    CLOCK_MONOTONIC).  Counts waits, timeouts and wait times.
+ *
+ */
+
+#include <stdint.h>
+
+#define UITF_WAIT_DEFAULT_NS   500000	/* 500 us */
+#define UITF_WAIT_SPIN_NS        5000	/* back-to-back polls for the first 5 us */
+#define UITF_WAIT_MAX_GAP_NS    64000	/* longest gap between polls */
+#define UITF_WAIT_NBINS            16	/* log2(us) histogram bins */
+
+typedef int32_t (*uitf_ready_t)(int32_t arg);
+
+typedef struct
+{
+  const char *name;
+  uint64_t deadline_ns;
+
+  uint64_t nwait;
+  uint64_t ntimeout;
+  uint64_t npoll;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint32_t hist[UITF_WAIT_NBINS];
+} uitf_wait_t;
+
+void    uitfWaitInit(uitf_wait_t *w, const char *name, uint64_t deadline_ns);
+void    uitfWaitReset(uitf_wait_t *w);
+int32_t uitfWait(uitf_wait_t *w, uitf_ready_t ready, int32_t arg);
+void    uitfWaitPrint(uitf_wait_t *w);